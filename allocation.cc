@@ -5,6 +5,7 @@
 #include <emu_c_utils/emu_c_utils.h>
 
 #include "common.h"
+#include "benchmark_driver.h"
 
 #ifndef __EMU_CC__
 #define RELEASE(X, Y) abort()
@@ -215,20 +216,20 @@ template<typename Allocator>
 void run_test(long block_size, long num_blocks, long num_threads, long num_trials)
 {
     long n_per_thread = num_blocks / num_threads;
-    for (long trial = 0; trial < num_trials; ++trial) {
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "allocation", num_trials, num_blocks,
+        "million allocations per second");
+    while (benchmark_driver_next(&driver)) {
         // Re-initialize the allocator for each trial
         auto allocator = create_allocator<Allocator>(block_size, num_blocks);
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin("allocation");
+        benchmark_driver_begin_trial(&driver);
         for (long i = 0; i < num_threads; ++i){
             cilk_spawn worker(allocator, block_size, n_per_thread);
         }
         cilk_sync;
-        double time_ms = hooks_region_end();
-        double mallocs_per_second = num_blocks / (time_ms/1000);
-        LOG("%3.2f million allocations per second\n",
-            mallocs_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
     }
+    benchmark_driver_finish(&driver);
 }
 
 int main(int argc, char** argv)
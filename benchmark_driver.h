@@ -0,0 +1,272 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <emu_c_utils/emu_c_utils.h>
+
+#include "common.h"
+
+/*
+ * Shared trial loop for all the benchmarks
+ *
+ * Each benchmark describes how much work one trial does (bytes moved, operations performed, etc.)
+ * and the driver takes care of warmup, timing, and reporting throughput, so that numbers are
+ * computed the same way in every executable.
+ *
+ * Usage:
+ *
+ *     benchmark_driver driver;
+ *     benchmark_driver_init(&driver, "region", num_trials, n * sizeof(long) * 3, "MB/s");
+ *     while (benchmark_driver_next(&driver)) {
+ *         // Per-trial setup goes here, it is not timed
+ *         benchmark_driver_begin_trial(&driver);
+ *         benchmark(data);
+ *         benchmark_driver_end_trial(&driver);
+ *         // Per-trial validation goes here, it is not timed
+ *     }
+ *     benchmark_driver_finish(&driver);
+ *
+ * The time of every trial is recorded, and a statistical summary is printed at the end.
+ * Setting BENCHMARK_CI_TARGET in the environment (i.e. 0.05) enables auto-repeat: trials are
+ * added until the 95% confidence interval of the mean time is within +/- that fraction of the
+ * mean, or until BENCHMARK_MAX_TRIALS (default 1000) trials have run.
+ */
+typedef struct benchmark_driver {
+    // Name of the timed region, passed to hooks_region_begin
+    const char * region;
+    // Number of untimed trials to run before the timed trials
+    long num_warmup;
+    // Number of timed trials, may grow if auto-repeat is enabled
+    long num_trials;
+    // Amount of work done in each trial, throughput is reported in millions of these per second
+    double work_per_trial;
+    // Label for the throughput, i.e. "MB/s" or "million operations per second"
+    const char * units;
+    // Number of trials started so far, including warmup trials
+    long num_started;
+    // Time of each timed trial
+    double * times_ms;
+    // Number of elements allocated for times_ms
+    long capacity;
+    // Keep adding trials until the CI half-width is below this fraction of the mean (0 to disable)
+    double ci_target;
+    // Upper limit on the number of trials when auto-repeat is enabled
+    long max_trials;
+} benchmark_driver;
+
+// Summary statistics over the time of each trial
+typedef struct benchmark_stats {
+    long count;
+    double min;
+    double median;
+    double p95;
+    double max;
+    double mean;
+    double stddev;
+    // 95% confidence interval for the mean
+    double ci_low;
+    double ci_high;
+    // Trials outside of the Tukey fences (1.5 * IQR beyond the quartiles)
+    long num_outliers;
+} benchmark_stats;
+
+static inline void
+benchmark_driver_init(benchmark_driver * driver, const char * region, long num_trials,
+    double work_per_trial, const char * units)
+{
+    driver->region = region;
+    driver->num_warmup = 0;
+    driver->num_trials = num_trials;
+    driver->work_per_trial = work_per_trial;
+    driver->units = units;
+    driver->num_started = 0;
+    driver->capacity = num_trials;
+    driver->times_ms = (double*)malloc(driver->capacity * sizeof(double));
+    runtime_assert(driver->times_ms != NULL, "Failed to allocate array for trial times");
+
+    const char * ci_target = getenv("BENCHMARK_CI_TARGET");
+    driver->ci_target = ci_target ? atof(ci_target) : 0;
+    const char * max_trials = getenv("BENCHMARK_MAX_TRIALS");
+    driver->max_trials = max_trials ? atol(max_trials) : 1000;
+}
+
+// Index of the current trial, negative during warmup
+static inline long
+benchmark_driver_trial(const benchmark_driver * driver)
+{
+    return driver->num_started - 1 - driver->num_warmup;
+}
+
+// Number of timed trials that have finished
+static inline long
+benchmark_driver_num_completed(const benchmark_driver * driver)
+{
+    long completed = driver->num_started - driver->num_warmup;
+    return completed < 0 ? 0 : completed;
+}
+
+// Millions of units of work per second
+static inline double
+benchmark_driver_throughput(const benchmark_driver * driver, double time_ms)
+{
+    return time_ms == 0 ? 0 : (driver->work_per_trial / 1e6) / (time_ms / 1000);
+}
+
+// Two-sided 95% critical value of Student's t distribution
+static inline double
+benchmark_t_value(long degrees_of_freedom)
+{
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+         2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+         2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    const long table_size = sizeof(table) / sizeof(table[0]);
+    if (degrees_of_freedom < 1) { return 0; }
+    if (degrees_of_freedom > table_size) { return 1.960; }
+    return table[degrees_of_freedom - 1];
+}
+
+static inline void
+benchmark_mean_ci(const double * times_ms, long n, double * mean, double * stddev, double * half_width)
+{
+    double sum = 0;
+    for (long i = 0; i < n; ++i) { sum += times_ms[i]; }
+    *mean = n > 0 ? sum / n : 0;
+
+    double sum_sq = 0;
+    for (long i = 0; i < n; ++i) { sum_sq += (times_ms[i] - *mean) * (times_ms[i] - *mean); }
+    *stddev = n > 1 ? sqrt(sum_sq / (n - 1)) : 0;
+    *half_width = n > 1 ? benchmark_t_value(n - 1) * *stddev / sqrt((double)n) : 0;
+}
+
+static inline int
+benchmark_compare_double(const void * a, const void * b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array
+static inline double
+benchmark_percentile(const double * sorted, long n, double p)
+{
+    long rank = (long)ceil(p * n);
+    if (rank < 1) { rank = 1; }
+    if (rank > n) { rank = n; }
+    return sorted[rank - 1];
+}
+
+static inline benchmark_stats
+benchmark_compute_stats(const double * times_ms, long n)
+{
+    benchmark_stats stats = {0};
+    stats.count = n;
+    if (n == 0) { return stats; }
+
+    double * sorted = (double*)malloc(n * sizeof(double));
+    runtime_assert(sorted != NULL, "Failed to allocate array for trial statistics");
+    for (long i = 0; i < n; ++i) { sorted[i] = times_ms[i]; }
+    qsort(sorted, n, sizeof(double), benchmark_compare_double);
+
+    stats.min = sorted[0];
+    stats.max = sorted[n - 1];
+    stats.median = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    stats.p95 = benchmark_percentile(sorted, n, 0.95);
+
+    double half_width;
+    benchmark_mean_ci(times_ms, n, &stats.mean, &stats.stddev, &half_width);
+    stats.ci_low = stats.mean - half_width;
+    stats.ci_high = stats.mean + half_width;
+
+    double q1 = benchmark_percentile(sorted, n, 0.25);
+    double q3 = benchmark_percentile(sorted, n, 0.75);
+    double iqr = q3 - q1;
+    for (long i = 0; i < n; ++i) {
+        if (sorted[i] < q1 - 1.5 * iqr || sorted[i] > q3 + 1.5 * iqr) {
+            stats.num_outliers += 1;
+        }
+    }
+
+    free(sorted);
+    return stats;
+}
+
+// Decide whether auto-repeat should add another trial
+static inline bool
+benchmark_driver_needs_more_trials(const benchmark_driver * driver)
+{
+    long n = benchmark_driver_num_completed(driver);
+    if (driver->ci_target <= 0 || n < 2 || n >= driver->max_trials) { return false; }
+    double mean, stddev, half_width;
+    benchmark_mean_ci(driver->times_ms, n, &mean, &stddev, &half_width);
+    return mean > 0 && half_width / mean > driver->ci_target;
+}
+
+// Advance to the next trial, returns false when all trials are done
+static inline bool
+benchmark_driver_next(benchmark_driver * driver)
+{
+    if (driver->num_started == driver->num_warmup + driver->num_trials) {
+        if (!benchmark_driver_needs_more_trials(driver)) { return false; }
+        driver->num_trials += 1;
+        if (driver->num_trials > driver->capacity) {
+            driver->capacity *= 2;
+            driver->times_ms = (double*)realloc(driver->times_ms, driver->capacity * sizeof(double));
+            runtime_assert(driver->times_ms != NULL, "Failed to allocate array for trial times");
+        }
+    }
+    driver->num_started += 1;
+    return true;
+}
+
+static inline void
+benchmark_driver_begin_trial(benchmark_driver * driver)
+{
+    long trial = benchmark_driver_trial(driver);
+    // Warmup trials run outside of the timed region
+    if (trial < 0) { return; }
+    hooks_set_attr_i64("trial", trial);
+    hooks_region_begin(driver->region);
+}
+
+// Returns the time taken by this trial (zero for warmup trials)
+static inline double
+benchmark_driver_end_trial(benchmark_driver * driver)
+{
+    long trial = benchmark_driver_trial(driver);
+    if (trial < 0) { return 0; }
+    double time_ms = hooks_region_end();
+    driver->times_ms[trial] = time_ms;
+    LOG("%3.2f %s\n", benchmark_driver_throughput(driver, time_ms), driver->units);
+    return time_ms;
+}
+
+// Prints a summary of all the timed trials, and returns the statistics
+static inline benchmark_stats
+benchmark_driver_finish(benchmark_driver * driver)
+{
+    long n = benchmark_driver_num_completed(driver);
+    benchmark_stats s = benchmark_compute_stats(driver->times_ms, n);
+    if (n > 1) {
+        LOG("Summary of %li trials (%li outliers):\n", s.count, s.num_outliers);
+        LOG("    time_ms: min %3.3f, median %3.3f, p95 %3.3f, max %3.3f, mean %3.3f, stddev %3.3f, 95%% CI [%3.3f, %3.3f]\n",
+            s.min, s.median, s.p95, s.max, s.mean, s.stddev, s.ci_low, s.ci_high);
+        // Slowest trials have the lowest throughput, so the tail is at the 5th percentile
+        LOG("    %s: max %3.2f, median %3.2f, p5 %3.2f, min %3.2f, mean %3.2f\n", driver->units,
+            benchmark_driver_throughput(driver, s.min),
+            benchmark_driver_throughput(driver, s.median),
+            benchmark_driver_throughput(driver, s.p95),
+            benchmark_driver_throughput(driver, s.max),
+            benchmark_driver_throughput(driver, s.mean));
+        if (driver->ci_target > 0 && s.mean > 0 && (s.ci_high - s.mean) / s.mean > driver->ci_target) {
+            LOG("WARNING: confidence interval did not converge after %li trials\n", n);
+        }
+    }
+    free(driver->times_ms);
+    driver->times_ms = NULL;
+    return s;
+}
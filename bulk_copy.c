@@ -8,6 +8,7 @@
 
 #include <emu_c_utils/emu_c_utils.h>
 #include "common.h"
+#include "benchmark_driver.h"
 
 typedef struct bulk_copy_data {
     long * src;
@@ -101,15 +102,14 @@ void bulk_copy_run(
     void (*benchmark)(bulk_copy_data *),
     long num_trials)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin("bulk_copy");
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "bulk_copy", num_trials, data->n * sizeof(long) * 2, "MB/s");
+    while (benchmark_driver_next(&driver)) {
+        benchmark_driver_begin_trial(&driver);
         benchmark(data);
-        double time_ms = hooks_region_end();
-        double bytes_per_second = time_ms == 0 ? 0 :
-            (data->n * sizeof(long) * 2) / (time_ms/1000);
-        LOG("%3.2f MB/s\n", bytes_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
     }
+    benchmark_driver_finish(&driver);
 }
 
 replicated bulk_copy_data data;
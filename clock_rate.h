@@ -0,0 +1,17 @@
+#pragma once
+
+#include <time.h>
+#include <emu_c_utils/emu_c_utils.h>
+
+// Measures the rate of CLOCK() in MHz against clock(), over 100 ms
+static inline double
+detect_clock_mhz(void)
+{
+    clock_t start = clock();
+    unsigned long startcycles = CLOCK();
+    clock_t now;
+    do { now = clock(); } while (now - start < CLOCKS_PER_SEC / 10);
+    unsigned long cycles = CLOCK() - startcycles;
+    double seconds = (double)(now - start) / CLOCKS_PER_SEC;
+    return (double)cycles / (seconds * 1e6);
+}
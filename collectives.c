@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <cilk/cilk.h>
+#include <string.h>
+
+#include <emu_c_utils/emu_c_utils.h>
+#include "common.h"
+#include "benchmark_driver.h"
+
+/*
+ * Collective operations between nodelets, using the same strategies as scatter
+ *
+ * Every nodelet has a replicated buffer of NODELETS() blocks of n elements.
+ * Block b on nodelet i starts out as collective_value(i, b, k).
+ *     gather          Block i of nodelet i is copied into block i of nodelet 0
+ *     allgather       Block i of nodelet i is copied into block i of every nodelet
+ *     reduce_scatter  Block j of every nodelet is added into block j of nodelet j
+ *     alltoall        Block j of nodelet i is copied into block i of nodelet j (in a second buffer)
+ */
+enum collective_type {
+    COLLECTIVE_GATHER,
+    COLLECTIVE_ALLGATHER,
+    COLLECTIVE_REDUCE_SCATTER,
+    COLLECTIVE_ALLTOALL,
+};
+
+typedef struct collectives_data {
+    // NODELETS() blocks of n elements on each nodelet
+    long * src;
+    // Same as src, except for alltoall
+    long * dst;
+    long n;
+    long num_threads;
+    // One of the collective_type values
+    long collective;
+} collectives_data;
+
+replicated collectives_data data;
+
+// Initialize a long* with mw_replicated_init
+void
+init_replicated_ptr(long ** loc, long * ptr)
+{
+    mw_replicated_init((long*)loc, (long)ptr);
+}
+
+static inline long
+collective_value(const collectives_data * data, long nlet, long block, long k)
+{
+    return (nlet * NODELETS() + block) * data->n + k;
+}
+
+// Transfer t of the collective: block src_block of nodelet from goes to block dst_block of nodelet to
+// Destinations are staggered so that the nodelets don't all send to the same place at once
+static inline void
+collective_transfer(const collectives_data * data, long t,
+    long * from, long * to, long * src_block, long * dst_block)
+{
+    if (data->collective == COLLECTIVE_GATHER) {
+        *from = t + 1;
+        *to = 0;
+    } else {
+        *from = t / (NODELETS() - 1);
+        *to = (*from + 1 + t % (NODELETS() - 1)) % NODELETS();
+    }
+    switch (data->collective) {
+        case COLLECTIVE_GATHER:
+        case COLLECTIVE_ALLGATHER:      *src_block = *dst_block = *from; break;
+        case COLLECTIVE_REDUCE_SCATTER: *src_block = *dst_block = *to; break;
+        default:                        *src_block = *to; *dst_block = *from; break;
+    }
+}
+
+static inline long
+collective_num_transfers(const collectives_data * data)
+{
+    return data->collective == COLLECTIVE_GATHER ? NODELETS() - 1 : NODELETS() * (NODELETS() - 1);
+}
+
+// Copy (or add, for reduce_scatter) elements [begin, end) of a block
+// Runs on the source nodelet, so reads are local and writes are remote
+static void
+transfer_range(long begin, long end, long * dst, const long * src, long add)
+{
+    if (add) {
+        for (long i = begin; i < end; ++i) {
+            REMOTE_ADD(&dst[i], src[i]);
+        }
+    } else {
+        for (long i = begin; i < end; ++i) {
+            dst[i] = src[i];
+        }
+    }
+}
+
+static noinline void
+transfer_worker_var(long begin, long end, va_list args)
+{
+    long * dst = va_arg(args, long*);
+    long * src = va_arg(args, long*);
+    long add = va_arg(args, long);
+    transfer_range(begin, end, dst, src, add);
+}
+
+// Pointers to the source and destination blocks of transfer t
+static inline void
+collective_transfer_blocks(const collectives_data * data, long t, long ** dst, long ** src)
+{
+    long from, to, src_block, dst_block;
+    collective_transfer(data, t, &from, &to, &src_block, &dst_block);
+    *src = (long*)mw_get_nth(data->src, from) + src_block * data->n;
+    *dst = (long*)mw_get_nth(data->dst, to) + dst_block * data->n;
+}
+
+void
+collectives_data_init(collectives_data * data, long collective, long n, long num_threads)
+{
+    mw_replicated_init(&data->collective, collective);
+    mw_replicated_init(&data->n, n);
+    mw_replicated_init(&data->num_threads, num_threads);
+
+    long * src = mw_mallocrepl(NODELETS() * n * sizeof(long));
+    runtime_assert(src != NULL, "Failed to allocate buffer");
+    init_replicated_ptr(&data->src, src);
+    long * dst = src;
+    if (collective == COLLECTIVE_ALLTOALL) {
+        dst = mw_mallocrepl(NODELETS() * n * sizeof(long));
+        runtime_assert(dst != NULL, "Failed to allocate buffer");
+    }
+    init_replicated_ptr(&data->dst, dst);
+}
+
+void
+collectives_data_deinit(collectives_data * data)
+{
+    if (data->dst != data->src) { mw_free(data->dst); }
+    mw_free(data->src);
+}
+
+static void
+collectives_fill_nodelet(collectives_data * data, long nlet)
+{
+    long * src = mw_get_nth(data->src, nlet);
+    long * dst = mw_get_nth(data->dst, nlet);
+    for (long b = 0; b < NODELETS(); ++b) {
+        for (long k = 0; k < data->n; ++k) {
+            src[b * data->n + k] = collective_value(data, nlet, b, k);
+        }
+    }
+    if (dst != src) { memset(dst, 0, NODELETS() * data->n * sizeof(long)); }
+}
+
+// Reset the buffers before each trial, since reduce_scatter and the trees change blocks in place
+noinline void
+collectives_fill(collectives_data * data)
+{
+    for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+        cilk_spawn_at(mw_get_nth(data->src, nlet)) collectives_fill_nodelet(data, nlet);
+    }
+}
+
+// Do each transfer with a memcpy
+noinline void
+collectives_memcpy(collectives_data * data)
+{
+    long add = data->collective == COLLECTIVE_REDUCE_SCATTER;
+    for (long t = 0; t < collective_num_transfers(data); ++t) {
+        long * dst, * src;
+        collective_transfer_blocks(data, t, &dst, &src);
+        // There is no memcpy that adds
+        if (add) { transfer_range(0, data->n, dst, src, add); }
+        else     { memcpy(dst, src, data->n * sizeof(long)); }
+    }
+}
+
+// Do each transfer with a serial for loop
+noinline void
+collectives_serial(collectives_data * data)
+{
+    long add = data->collective == COLLECTIVE_REDUCE_SCATTER;
+    for (long t = 0; t < collective_num_transfers(data); ++t) {
+        long * dst, * src;
+        collective_transfer_blocks(data, t, &dst, &src);
+        transfer_range(0, data->n, dst, src, add);
+    }
+}
+
+// Spawn one thread for each transfer, on the source nodelet
+noinline void
+collectives_parallel(collectives_data * data)
+{
+    long add = data->collective == COLLECTIVE_REDUCE_SCATTER;
+    for (long t = 0; t < collective_num_transfers(data); ++t) {
+        long * dst, * src;
+        collective_transfer_blocks(data, t, &dst, &src);
+        cilk_spawn_at(src) transfer_range(0, data->n, dst, src, add);
+    }
+}
+
+static noinline void
+collectives_emu_for_worker(long begin, long end, long grain, long * dst, long * src, long add)
+{
+    for (long i = begin; i < end; i += grain) {
+        long first = i;
+        long last = first + grain <= end ? first + grain : end;
+        cilk_spawn transfer_range(first, last, dst, src, add);
+    }
+}
+
+// Split the transfers into grains, being careful not to exhaust total # of threads
+noinline void
+collectives_emu_for(collectives_data * data)
+{
+    long add = data->collective == COLLECTIVE_REDUCE_SCATTER;
+    long num_transfers = collective_num_transfers(data);
+    long grain = (data->n * num_transfers) / data->num_threads;
+    if (grain < 1) { grain = 1; }
+    for (long t = 0; t < num_transfers; ++t) {
+        long * dst, * src;
+        collective_transfer_blocks(data, t, &dst, &src);
+        cilk_spawn_at(src) collectives_emu_for_worker(0, data->n, grain, dst, src, add);
+    }
+}
+
+// Copy elements [begin, end) of the buffer from one nodelet to another
+static void
+tree_copy(long * buffer, long begin, long end, long from, long to)
+{
+    long * src = mw_get_nth(buffer, from);
+    long * dst = mw_get_nth(buffer, to);
+    emu_local_for(begin, end, LOCAL_GRAIN_MIN(end - begin, 64),
+        transfer_worker_var, dst, src, 0L
+    );
+}
+
+// Binomial tree gather, the reverse of scatter_tree:
+// afterwards nodelet nlet_begin has blocks [nlet_begin, nlet_end)
+static void
+gather_tree(long * buffer, long n, long nlet_begin, long nlet_end)
+{
+    long num_nodelets = nlet_end - nlet_begin;
+    if (num_nodelets == 1) { return; }
+    long nlet_mid = nlet_begin + (num_nodelets / 2);
+
+    // Gather both halves, then send the upper half down
+    cilk_spawn_at(mw_get_nth(buffer, nlet_mid)) gather_tree(buffer, n, nlet_mid, nlet_end);
+    gather_tree(buffer, n, nlet_begin, nlet_mid);
+    cilk_sync;
+    tree_copy(buffer, nlet_mid * n, nlet_end * n, nlet_mid, nlet_begin);
+}
+
+// Tree broadcast of the whole buffer, like scatter_tree
+static void
+broadcast_tree(long * buffer, long n, long nlet_begin, long nlet_end)
+{
+    long num_nodelets = nlet_end - nlet_begin;
+    if (num_nodelets == 1) { return; }
+    long nlet_mid = nlet_begin + (num_nodelets / 2);
+
+    tree_copy(buffer, 0, NODELETS() * n, nlet_begin, nlet_mid);
+    cilk_spawn_at(mw_get_nth(buffer, nlet_mid)) broadcast_tree(buffer, n, nlet_mid, nlet_end);
+    broadcast_tree(buffer, n, nlet_begin, nlet_mid);
+}
+
+static void
+reduce_scatter_exchange(long * buffer, long n, long from, long to, long block_begin, long block_end)
+{
+    long * src = mw_get_nth(buffer, from);
+    long * dst = mw_get_nth(buffer, to);
+    transfer_range(block_begin * n, block_end * n, dst, src, 1);
+}
+
+// Recursive halving: nodelet k of the lower half adds its partial sums for the upper half's blocks
+// into nodelet k of the upper half, and the other way around. Then each half recurses on its own blocks.
+// Requires a power of two number of nodelets.
+static void
+reduce_scatter_tree(long * buffer, long n, long nlet_begin, long nlet_end)
+{
+    long num_nodelets = nlet_end - nlet_begin;
+    if (num_nodelets == 1) { return; }
+    long nlet_mid = nlet_begin + (num_nodelets / 2);
+
+    for (long k = 0; k < num_nodelets / 2; ++k) {
+        long lower = nlet_begin + k, upper = nlet_mid + k;
+        cilk_spawn_at(mw_get_nth(buffer, lower)) reduce_scatter_exchange(buffer, n, lower, upper, nlet_mid, nlet_end);
+        cilk_spawn_at(mw_get_nth(buffer, upper)) reduce_scatter_exchange(buffer, n, upper, lower, nlet_begin, nlet_mid);
+    }
+    cilk_sync;
+    cilk_spawn_at(mw_get_nth(buffer, nlet_mid)) reduce_scatter_tree(buffer, n, nlet_mid, nlet_end);
+    reduce_scatter_tree(buffer, n, nlet_begin, nlet_mid);
+}
+
+noinline void
+collectives_tree(collectives_data * data)
+{
+    switch (data->collective) {
+        case COLLECTIVE_GATHER:
+            gather_tree(data->src, data->n, 0, NODELETS());
+            break;
+        case COLLECTIVE_ALLGATHER:
+            gather_tree(data->src, data->n, 0, NODELETS());
+            broadcast_tree(data->src, data->n, 0, NODELETS());
+            break;
+        case COLLECTIVE_REDUCE_SCATTER:
+            reduce_scatter_tree(data->src, data->n, 0, NODELETS());
+            break;
+    }
+}
+
+// Checks the blocks that the collective is supposed to deliver
+void
+collectives_validate(collectives_data * data)
+{
+    for (long t = 0; t < collective_num_transfers(data); ++t) {
+        long from, to, src_block, dst_block;
+        collective_transfer(data, t, &from, &to, &src_block, &dst_block);
+        // reduce_scatter is checked once per destination block, against the sum over all nodelets
+        if (data->collective == COLLECTIVE_REDUCE_SCATTER && from != (to + 1) % NODELETS()) { continue; }
+        long * dst = (long*)mw_get_nth(data->dst, to) + dst_block * data->n;
+        for (long k = 0; k < data->n; ++k) {
+            long expected = collective_value(data, from, src_block, k);
+            if (data->collective == COLLECTIVE_REDUCE_SCATTER) {
+                expected = 0;
+                for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+                    expected += collective_value(data, nlet, dst_block, k);
+                }
+            }
+            if (dst[k] != expected) {
+                LOG("Error in validation: nodelet %li block %li element %li is %li, expected %li\n",
+                    to, dst_block, k, dst[k], expected);
+                exit(1);
+            }
+        }
+    }
+}
+
+// Bytes of the collective that cross between the two halves of the nodelets
+static inline double
+collectives_bisection_bytes(const collectives_data * data)
+{
+    long crossing = 0;
+    for (long t = 0; t < collective_num_transfers(data); ++t) {
+        long from, to, src_block, dst_block;
+        collective_transfer(data, t, &from, &to, &src_block, &dst_block);
+        if ((from < NODELETS() / 2) != (to < NODELETS() / 2)) { ++crossing; }
+    }
+    return (double)crossing * data->n * sizeof(long);
+}
+
+void collectives_run(
+    collectives_data * data,
+    const char * name,
+    void (*benchmark)(collectives_data *),
+    long num_trials)
+{
+    // Bandwidth counts the data the collective has to deliver, not what each strategy actually moves
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, name, num_trials,
+        (double)collective_num_transfers(data) * data->n * sizeof(long), "MB/s");
+    while (benchmark_driver_next(&driver)) {
+        collectives_fill(data);
+        benchmark_driver_begin_trial(&driver);
+        benchmark(data);
+        benchmark_driver_end_trial(&driver);
+#ifndef NO_VALIDATE
+        collectives_validate(data);
+#endif
+    }
+    benchmark_stats stats = benchmark_driver_finish(&driver);
+    double total_mbps = benchmark_driver_throughput(&driver, stats.median);
+    double bisection_mbps = stats.median == 0 ? 0 : collectives_bisection_bytes(data) / 1e6 / (stats.median / 1000);
+    LOG("Effective bandwidth with %li nodelets: %3.2f MB/s, %3.2f MB/s per nodelet, bisection %3.2f MB/s\n",
+        NODELETS(), total_mbps, total_mbps / NODELETS(), bisection_mbps);
+}
+
+int main(int argc, char** argv)
+{
+    struct {
+        const char* collective;
+        const char* mode;
+        long log2_num_elements;
+        long num_threads;
+        long num_trials;
+    } args;
+
+    if (argc != 6) {
+        LOG("Usage: %s collective mode log2_num_elements num_threads num_trials\n", argv[0]);
+        exit(1);
+    } else {
+        args.collective = argv[1];
+        args.mode = argv[2];
+        args.log2_num_elements = atol(argv[3]);
+        args.num_threads = atol(argv[4]);
+        args.num_trials = atol(argv[5]);
+
+        if (args.log2_num_elements < 0) { LOG("log2_num_elements must be >= 0"); exit(1); }
+        if (args.num_threads <= 0) { LOG("num_threads must be > 0"); exit(1); }
+        if (args.num_trials <= 0) { LOG("num_trials must be > 0"); exit(1); }
+    }
+
+    long collective;
+    if      (!strcmp(args.collective, "gather"))         { collective = COLLECTIVE_GATHER; }
+    else if (!strcmp(args.collective, "allgather"))      { collective = COLLECTIVE_ALLGATHER; }
+    else if (!strcmp(args.collective, "reduce_scatter")) { collective = COLLECTIVE_REDUCE_SCATTER; }
+    else if (!strcmp(args.collective, "alltoall"))       { collective = COLLECTIVE_ALLTOALL; }
+    else { LOG("Collective %s not implemented!\n", args.collective); exit(1); }
+
+    if (NODELETS() < 2) { LOG("Collectives need at least 2 nodelets\n"); exit(1); }
+    if (!strcmp(args.mode, "tree")) {
+        if (collective == COLLECTIVE_ALLTOALL) { LOG("There is no tree mode for alltoall\n"); exit(1); }
+        if (collective == COLLECTIVE_REDUCE_SCATTER && (NODELETS() & (NODELETS() - 1))) {
+            LOG("reduce_scatter tree requires a power of two number of nodelets\n"); exit(1);
+        }
+    }
+
+    hooks_set_attr_str("collective", args.collective);
+    hooks_set_attr_str("mode", args.mode);
+    hooks_set_attr_i64("log2_num_elements", args.log2_num_elements);
+    hooks_set_attr_i64("num_threads", args.num_threads);
+    hooks_set_attr_i64("num_nodelets", NODELETS());
+    hooks_set_attr_i64("num_bytes_per_element", sizeof(long));
+
+    long n = 1L << args.log2_num_elements;
+    long mbytes = NODELETS() * n * sizeof(long) / (1024*1024);
+    LOG("Initializing buffers with %li blocks of %li elements each (%li MiB per nodelet)\n", NODELETS(), n, mbytes);
+    collectives_data_init(&data, collective, n, args.num_threads);
+    LOG("Running %s with %s\n", args.collective, args.mode);
+
+    #define RUN_BENCHMARK(X) collectives_run(&data, args.collective, X, args.num_trials)
+
+    if (!strcmp(args.mode, "memcpy")) {
+        RUN_BENCHMARK(collectives_memcpy);
+    } else if (!strcmp(args.mode, "serial")) {
+        RUN_BENCHMARK(collectives_serial);
+    } else if (!strcmp(args.mode, "parallel_simple")) {
+        RUN_BENCHMARK(collectives_parallel);
+    } else if (!strcmp(args.mode, "emu_for")) {
+        RUN_BENCHMARK(collectives_emu_for);
+    } else if (!strcmp(args.mode, "tree")) {
+        RUN_BENCHMARK(collectives_tree);
+    } else {
+        LOG("Spawn mode %s not implemented!", args.mode);
+    }
+
+    collectives_data_deinit(&data);
+    return 0;
+}
@@ -156,6 +156,9 @@ def generate_script(args, script_dir, out_dir, local_config, no_redirect, no_alg
 
     if args.benchmark in ["local_stream", "global_stream", "global_stream_1d", "local_stream_cxx"]:
         # Generate the benchmark command line
+        if "kernel" in args:
+            template += """
+        --kernel {kernel} \\"""
         template += """
         {spawn_mode} {log2_num_elements} {num_threads} 1 \\
         &>> $LOGFILE
@@ -178,10 +181,61 @@ def generate_script(args, script_dir, out_dir, local_config, no_redirect, no_alg
         &>> $LOGFILE
         """
 
+    elif args.benchmark == "hot_range":
+        # Generate the benchmark command line
+        if "layout" in args:
+            template += """
+        --layout {layout} \\"""
+        template += """
+        --log2_num_elements {log2_num_elements} \\
+        --num_threads {num_threads} \\
+        --op_mode {op_mode} \\
+        --log2_offset {log2_offset} \\
+        --log2_length {log2_length} \\
+        --num_trials {num_trials} \\
+        &>> $LOGFILE
+        """
+
     elif args.benchmark == "ping_pong":
         # Generate the benchmark command line
+        # src = dst = -1 measures all pairs, concurrent runs disjoint pairs at the same time
+        if args.get("concurrent"):
+            template += """
+        -c \\"""
+        # background load on some or all nodelets while measuring
+        if args.get("load", "none") != "none":
+            template += """
+        -l {load} -b {background_threads} \\"""
+            if args.get("loaded_nodelets"):
+                template += """
+        -L {loaded_nodelets} \\"""
+        # sweep_threads replaces num_threads with a sweep up to that many threads on one pair
+        if args.get("sweep_threads"):
+            template += """
+        -s {src} -d {dst} -m {log2_num_migrations} -w {sweep_threads} -r {num_trials} \\
+        -p {outdir}/{name}.threads.csv \\
+        &>> $LOGFILE
+        """
+        else:
+            template += """
+        -s {src} -d {dst} -m {log2_num_migrations} -t {num_threads} -r {num_trials} \\
+        -o {outdir}/{name}.matrix.csv \\
+        &>> $LOGFILE
+        """
+
+    elif args.benchmark == "collectives":
+        # Generate the benchmark command line
+        template += """
+        {collective} {mode} {log2_num_elements} {num_threads} {num_trials} \\
+        &>> $LOGFILE
+        """
+
+    elif args.benchmark == "message_pass":
+        # Generate the benchmark command line
+        # Sweeps payloads from min_bytes to max_bytes for each mode (remote, migrate or both)
         template += """
-        {mode} {log2_num_migrations} {num_threads} {num_trials} \\
+        -s {src} -d {dst} -m {log2_num_messages} -t {num_threads} -r {num_trials} \\
+        -b {min_bytes} -B {max_bytes} -M {mode} \\
         &>> $LOGFILE
         """
 
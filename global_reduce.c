@@ -8,6 +8,7 @@
 #include <emu_c_utils/emu_c_utils.h>
 
 #include "common.h"
+#include "benchmark_driver.h"
 
 typedef struct global_reduce_data {
     emu_chunked_array array_a;
@@ -96,16 +97,15 @@ void global_reduce_run(
     long (*benchmark)(global_reduce_data *),
     long num_trials)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin(name);
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, name, num_trials, data->n * sizeof(long), "MB/s");
+    while (benchmark_driver_next(&driver)) {
+        benchmark_driver_begin_trial(&driver);
         long sum = benchmark(data);
-        double time_ms = hooks_region_end();
+        benchmark_driver_end_trial(&driver);
         runtime_assert(sum == data->n, "Validation FAILED!");
-        double bytes_per_second = time_ms == 0 ? 0 :
-            (data->n * sizeof(long)) / (time_ms/1000);
-        LOG("%3.2f MB/s\n", bytes_per_second / (1000000));
     }
+    benchmark_driver_finish(&driver);
 }
 
 
@@ -5,8 +5,14 @@
 #include <cilk/cilk.h>
 #include <assert.h>
 #include <string.h>
+#include <getopt.h>
 
 #include "common.h"
+#include "benchmark_driver.h"
+#include "thread_sweep.h"
+#include "stream_kernel.h"
+#include "native_numa.h"
+#include "stream_simd.h"
 
 #include <emu_c_utils/emu_c_utils.h>
 #include "recursive_spawn.h"
@@ -21,14 +27,17 @@ typedef struct global_stream_data {
     long ** c;
     long n;
     long num_threads;
+    // One of the stream_kernel values
+    long kernel;
 } global_stream_data;
 
 
 // #define INDEX(PTR, BLOCK, I) (PTR[I/BLOCK][I%BLOCK])
 #define INDEX(PTR, BLOCK, I) (PTR[I >> PRIORITY(BLOCK)][I&(BLOCK-1)])
 
+// Allocates the arrays without touching them
 void
-global_stream_init(global_stream_data * data, long n)
+global_stream_alloc(global_stream_data * data, long n)
 {
     data->n = n;
     emu_chunked_array_replicated_init(&data->array_a, n, sizeof(long));
@@ -46,10 +55,48 @@ global_stream_init(global_stream_data * data, long n)
         memcpy(remote_data, data, sizeof(global_stream_data));
     }
 #endif
+    // On native builds, place each chunk on the NUMA node for its nodelet before first touch
+    long local_n = n / NODELETS();
+    for (long i = 0; i < NODELETS(); ++i) {
+        native_place_on_nodelet(data->a[i], local_n * sizeof(long), i);
+        native_place_on_nodelet(data->b[i], local_n * sizeof(long), i);
+        native_place_on_nodelet(data->c[i], local_n * sizeof(long), i);
+    }
+}
+
+static void
+global_stream_first_touch_worker(emu_chunked_array * array, long begin, long end, va_list args)
+{
+    (void)array;
+    global_stream_data * data = va_arg(args, global_stream_data *);
+    long block_sz = data->n / NODELETS();
+
+    long * c = &INDEX(data->c, block_sz, begin);
+    long * b = &INDEX(data->b, block_sz, begin);
+    long * a = &INDEX(data->a, block_sz, begin);
+
+    for (long i = 0; i < end-begin; ++i) {
+        a[i] = 1;
+        b[i] = 2;
+        c[i] = 0;
+    }
+}
+
+// Writes initial values to each array, using num_threads threads
+void
+global_stream_first_touch(global_stream_data * data)
+{
+    emu_chunked_array_apply(&data->array_a, data->n / data->num_threads,
+        global_stream_first_touch_worker, data
+    );
+}
+
+void
+global_stream_init(global_stream_data * data, long n)
+{
+    global_stream_alloc(data, n);
 #ifndef NO_VALIDATE
-    emu_chunked_array_set_long(&data->array_a, 1);
-    emu_chunked_array_set_long(&data->array_b, 2);
-    emu_chunked_array_set_long(&data->array_c, 0);
+    global_stream_first_touch(data);
 #endif
 }
 
@@ -65,9 +112,10 @@ static void
 global_stream_validate_worker(emu_chunked_array * array, long begin, long end, va_list args)
 {
     long * c = emu_chunked_array_index(array, begin);
+    long expected = va_arg(args, long);
     for (long i = 0; i < end - begin; ++i) {
-        if (c[i] != 3) {
-            LOG("VALIDATION ERROR: c[%li] == %li (supposed to be 3)\n", begin + i, c[i]);
+        if (c[i] != expected) {
+            LOG("VALIDATION ERROR: c[%li] == %li (supposed to be %li)\n", begin + i, c[i], expected);
             exit(1);
         }
     }
@@ -77,7 +125,7 @@ void
 global_stream_validate(global_stream_data * data)
 {
     emu_chunked_array_apply(&data->array_c, GLOBAL_GRAIN(data->n),
-        global_stream_validate_worker
+        global_stream_validate_worker, stream_kernel_expected(data->kernel)
     );
 }
 
@@ -87,7 +135,7 @@ global_stream_add_serial(global_stream_data * data)
 {
     long block_sz = data->n / NODELETS();
     for (long i = 0; i < data->n; ++i) {
-        INDEX(data->c, block_sz, i) = INDEX(data->a, block_sz, i) + INDEX(data->b, block_sz, i);
+        STREAM_KERNEL_APPLY(data->kernel, INDEX(data->c, block_sz, i), INDEX(data->a, block_sz, i), INDEX(data->b, block_sz, i));
     }
 }
 
@@ -100,7 +148,7 @@ global_stream_add_cilk_for(global_stream_data * data)
     #pragma cilk grainsize = data->n / data->num_threads
 #endif
     cilk_for (long i = 0; i < data->n; ++i) {
-        INDEX(data->c, block_sz, i) = INDEX(data->a, block_sz, i) + INDEX(data->b, block_sz, i);
+        STREAM_KERNEL_APPLY(data->kernel, INDEX(data->c, block_sz, i), INDEX(data->a, block_sz, i), INDEX(data->b, block_sz, i));
     }
 }
 
@@ -109,7 +157,7 @@ recursive_spawn_add_worker(long begin, long end, global_stream_data *data)
 {
     long block_sz = data->n / NODELETS();
     for (long i = begin; i < end; ++i) {
-        INDEX(data->c, block_sz, i) = INDEX(data->a, block_sz, i) + INDEX(data->b, block_sz, i);
+        STREAM_KERNEL_APPLY(data->kernel, INDEX(data->c, block_sz, i), INDEX(data->a, block_sz, i), INDEX(data->b, block_sz, i));
     }
 }
 
@@ -139,21 +187,24 @@ global_stream_add_serial_spawn(global_stream_data * data)
     cilk_sync;
 }
 
+// numa_node is where the chunk was placed (native_nodelet_node), -1 to run anywhere
 void
-serial_remote_spawn_level2(long begin, long end, long * a, long * b, long * c)
+serial_remote_spawn_level2(long begin, long end, long * a, long * b, long * c, long kernel, long numa_node)
 {
+    native_affinity saved = native_pin_to_node(numa_node);
     for (long i = begin; i < end; ++i) {
-        c[i] = a[i] + b[i];
+        STREAM_KERNEL_APPLY(kernel, c[i], a[i], b[i]);
     }
+    native_unpin(saved);
 }
 
 void
-serial_remote_spawn_level1(long * a, long * b, long * c, long n, long grain)
+serial_remote_spawn_level1(long * a, long * b, long * c, long n, long grain, long kernel, long numa_node)
 {
     for (long i = 0; i < n; i += grain) {
         long begin = i;
         long end = begin + grain <= n ? begin + grain : n;
-        cilk_spawn serial_remote_spawn_level2(begin, end, a, b, c);
+        cilk_spawn serial_remote_spawn_level2(begin, end, a, b, c, kernel, numa_node);
     }
     cilk_sync;
 }
@@ -168,23 +219,26 @@ global_stream_add_serial_remote_spawn(global_stream_data * data)
     long grain = data->n / data->num_threads;
     // Spawn a thread on each nodelet
     for (long i = 0; i < NODELETS(); ++i) {
-        cilk_spawn_at(data->a[i]) serial_remote_spawn_level1(data->a[i], data->b[i], data->c[i], local_n, grain);
+        cilk_spawn_at(data->a[i]) serial_remote_spawn_level1(data->a[i], data->b[i], data->c[i], local_n, grain, data->kernel,
+            native_nodelet_node(i));
     }
     cilk_sync;
 }
 
 void
-recursive_remote_spawn_level2_worker(long begin, long end, long * a, long * b, long * c)
+recursive_remote_spawn_level2_worker(long begin, long end, long * a, long * b, long * c, long kernel, long numa_node)
 {
+    native_affinity saved = native_pin_to_node(numa_node);
     for (long i = begin; i < end; ++i) {
-        c[i] = a[i] + b[i];
+        STREAM_KERNEL_APPLY(kernel, c[i], a[i], b[i]);
     }
+    native_unpin(saved);
 }
 
 void
-recursive_remote_spawn_level2(long begin, long end, long grain, long * a, long * b, long * c)
+recursive_remote_spawn_level2(long begin, long end, long grain, long * a, long * b, long * c, long kernel, long numa_node)
 {
-    RECURSIVE_CILK_SPAWN(begin, end, grain, recursive_remote_spawn_level2, a, b, c);
+    RECURSIVE_CILK_SPAWN(begin, end, grain, recursive_remote_spawn_level2, a, b, c, kernel, numa_node);
 }
 
 void
@@ -201,7 +255,8 @@ recursive_remote_spawn_level1(long low, long high, global_stream_data * data)
     /* Recursive base case: call worker function */
     long local_n = data->n / NODELETS();
     long grain = data->n / data->num_threads;
-    recursive_remote_spawn_level2(0, local_n, grain, data->a[low], data->b[low], data->c[low]);
+    recursive_remote_spawn_level2(0, local_n, grain, data->a[low], data->b[low], data->c[low], data->kernel,
+        native_nodelet_node(low));
 }
 
 // recursive_remote_spawn - Recursively spawns threads to divice up the loop range, using remote spawns where possible.
@@ -223,7 +278,7 @@ global_stream_add_library_worker(emu_chunked_array * array, long begin, long end
     long * a = &INDEX(data->a, block_sz, begin);
 
     for (long i = 0; i < end-begin; ++i) {
-        c[i] = a[i] + b[i];
+        STREAM_KERNEL_APPLY(data->kernel, c[i], a[i], b[i]);
     }
 }
 
@@ -246,30 +301,129 @@ global_stream_add_serial_remote_spawn_shallow(global_stream_data * data)
         long * a = data->a[i];
         long * b = data->b[i];
         long * c = data->c[i];
+        long numa_node = native_nodelet_node(i);
         for (long j = 0; j < local_n; j += grain) {
             long begin = j;
             long end = begin + grain <= local_n ? begin + grain : local_n;
-            cilk_spawn_at(a) serial_remote_spawn_level2(begin, end, a, b, c);
+            cilk_spawn_at(a) serial_remote_spawn_level2(begin, end, a, b, c, data->kernel, numa_node);
         }
     }
     cilk_sync;
 }
 
-void global_stream_run(
+#ifdef HAVE_STREAM_SIMD
+static noinline void
+simd_level2(long begin, long end, long * a, long * b, long * c, long kernel, bool nontemporal, long numa_node)
+{
+    native_affinity saved = native_pin_to_node(numa_node);
+    if (nontemporal) {
+        stream_simd_kernel_nt(kernel, c, a, b, begin, end);
+    } else {
+        stream_simd_kernel(kernel, c, a, b, begin, end);
+    }
+    native_unpin(saved);
+}
+
+static void
+simd_level1(long * a, long * b, long * c, long n, long grain, long kernel, bool nontemporal, long numa_node)
+{
+    for (long i = 0; i < n; i += grain) {
+        long begin = i;
+        long end = begin + grain <= n ? begin + grain : n;
+        cilk_spawn simd_level2(begin, end, a, b, c, kernel, nontemporal, numa_node);
+    }
+    cilk_sync;
+}
+
+static void
+global_stream_add_simd_common(global_stream_data * data, bool nontemporal)
+{
+    long local_n = data->n / NODELETS();
+    long grain = data->n / data->num_threads;
+    for (long i = 0; i < NODELETS(); ++i) {
+        cilk_spawn_at(data->a[i]) simd_level1(data->a[i], data->b[i], data->c[i], local_n, grain, data->kernel, nontemporal,
+            native_nodelet_node(i));
+    }
+    cilk_sync;
+}
+
+// simd - serial_remote_spawn with an explicitly vectorized worker
+void
+global_stream_add_simd(global_stream_data * data)
+{
+    global_stream_add_simd_common(data, false);
+}
+
+// simd_nt - same as simd, but with non-temporal (streaming) stores
+void
+global_stream_add_simd_nt(global_stream_data * data)
+{
+    global_stream_add_simd_common(data, true);
+}
+#endif
+
+double global_stream_run(
     global_stream_data * data,
     const char * name,
     void (*benchmark)(global_stream_data *),
-    long num_trials)
+    long num_trials,
+    long num_warmup)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin(name);
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, name, num_trials,
+        data->n * stream_kernel_bytes_per_element(data->kernel), "MB/s");
+    driver.num_warmup = num_warmup;
+    native_pin_overhead_reset();
+    while (benchmark_driver_next(&driver)) {
+        benchmark_driver_begin_trial(&driver);
         benchmark(data);
-        double time_ms = hooks_region_end();
-        double bytes_per_second = time_ms == 0 ? 0 :
-            (data->n * sizeof(long) * 3) / (time_ms/1000);
-        LOG("%3.2f MB/s\n", bytes_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
+    }
+    benchmark_stats stats = benchmark_driver_finish(&driver);
+    if (native_pin_overhead_ms() > 0) {
+        // Summed over all workers, so it can be more than the elapsed time
+        LOG("NUMA pinning took %3.3f ms of worker time per trial, included in the times above\n",
+            native_pin_overhead_ms() / driver.num_started);
+    }
+    return benchmark_driver_throughput(&driver, stats.median);
+}
+
+// first_touch - time only the initial write to freshly allocated arrays
+double global_stream_first_touch_run(
+    global_stream_data * data,
+    long num_trials,
+    long num_warmup)
+{
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "first_touch", num_trials, data->n * sizeof(long) * 3, "MB/s");
+    driver.num_warmup = num_warmup;
+    while (benchmark_driver_next(&driver)) {
+        // Replace the arrays with allocations that have never been touched
+        global_stream_deinit(data);
+        global_stream_alloc(data, data->n);
+        benchmark_driver_begin_trial(&driver);
+        global_stream_first_touch(data);
+        benchmark_driver_end_trial(&driver);
     }
+    benchmark_stats stats = benchmark_driver_finish(&driver);
+    return benchmark_driver_throughput(&driver, stats.median);
+}
+
+static const struct option long_options[] = {
+    {"warmup"       , required_argument},
+    {"kernel"       , required_argument},
+    {"help"         , no_argument},
+    {NULL}
+};
+
+static void
+print_help(const char* argv0)
+{
+    LOG("Usage: %s [OPTIONS] mode log2_num_elements num_threads num_trials\n", argv0);
+    LOG("\t--warmup             Number of untimed trials to run first\n");
+    LOG("\t--kernel             STREAM kernel to run: copy, scale, add (default), or triad\n");
+    LOG("num_threads can be a list (8,16,32) or a range (8:512:x2, 8:64:+8) to sweep thread counts in one run\n");
+    LOG("\t--help               Print command line help\n");
 }
 
 replicated global_stream_data data;
@@ -279,69 +433,133 @@ int main(int argc, char** argv)
     struct {
         const char* mode;
         long log2_num_elements;
-        long num_threads;
+        thread_sweep threads;
         long num_trials;
+        long num_warmup;
+        long kernel;
     } args;
+    args.num_warmup = 0;
+    args.kernel = STREAM_ADD;
+
+    int option_index;
+    while (true)
+    {
+        int c = getopt_long(argc, argv, "", long_options, &option_index);
+        // Done parsing
+        if (c == -1) { break; }
+        // Parse error
+        if (c == '?') {
+            LOG("Invalid arguments\n");
+            print_help(argv[0]);
+            exit(1);
+        }
+        const char* option_name = long_options[option_index].name;
+
+        if (!strcmp(option_name, "warmup")) {
+            args.num_warmup = atol(optarg);
+        } else if (!strcmp(option_name, "kernel")) {
+            if (!stream_kernel_parse(optarg, &args.kernel)) {
+                LOG("Kernel %s not implemented!\n", optarg);
+                exit(1);
+            }
+        } else if (!strcmp(option_name, "help")) {
+            print_help(argv[0]);
+            exit(1);
+        }
+    }
 
-    if (argc != 5) {
-        LOG("Usage: %s mode log2_num_elements num_threads num_trials\n", argv[0]);
+    if (argc - optind != 4) {
+        print_help(argv[0]);
         exit(1);
     } else {
-        args.mode = argv[1];
-        args.log2_num_elements = atol(argv[2]);
-        args.num_threads = atol(argv[3]);
-        args.num_trials = atol(argv[4]);
+        args.mode = argv[optind + 0];
+        args.log2_num_elements = atol(argv[optind + 1]);
+        args.threads = thread_sweep_parse(argv[optind + 2]);
+        args.num_trials = atol(argv[optind + 3]);
 
         if (args.log2_num_elements <= 0) { LOG("log2_num_elements must be > 0"); exit(1); }
-        if (args.num_threads <= 0) { LOG("num_threads must be > 0"); exit(1); }
         if (args.num_trials <= 0) { LOG("num_trials must be > 0"); exit(1); }
+        if (args.num_warmup < 0) { LOG("warmup must be >= 0"); exit(1); }
     }
 
     hooks_set_attr_str("spawn_mode", args.mode);
     hooks_set_attr_i64("log2_num_elements", args.log2_num_elements);
-    hooks_set_attr_i64("num_threads", args.num_threads);
+    hooks_set_attr_i64("num_warmup", args.num_warmup);
+    hooks_set_attr_str("kernel", stream_kernel_name(args.kernel));
     hooks_set_attr_i64("num_nodelets", NODELETS());
-    hooks_set_attr_i64("num_bytes_per_element", sizeof(long) * 3);
+    hooks_set_attr_i64("num_bytes_per_element", stream_kernel_bytes_per_element(args.kernel));
 
     long n = 1L << args.log2_num_elements;
     long mbytes = n * sizeof(long) / (1024*1024);
     long mbytes_per_nodelet = mbytes / NODELETS();
     LOG("Initializing arrays with %li elements each (%li MiB total, %li MiB per nodelet)\n", 3 * n, 3 * mbytes, 3 * mbytes_per_nodelet);
     fflush(stdout);
-    data.num_threads = args.num_threads;
+    data.num_threads = args.threads.values[0];
+    mw_replicated_init(&data.kernel, args.kernel);
     global_stream_init(&data, n);
-    LOG("Doing vector addition using %s\n", args.mode); fflush(stdout);
-
-    #define RUN_BENCHMARK(X) global_stream_run(&data, args.mode, X, args.num_trials)
-
-    if (!strcmp(args.mode, "cilk_for")) {
-        RUN_BENCHMARK(global_stream_add_cilk_for);
-    } else if (!strcmp(args.mode, "serial_spawn")) {
-        RUN_BENCHMARK(global_stream_add_serial_spawn);
-    } else if (!strcmp(args.mode, "serial_remote_spawn")) {
-        runtime_assert(data.num_threads >= NODELETS(), "serial_remote_spawn mode will always use at least one thread per nodelet");
-        RUN_BENCHMARK(global_stream_add_serial_remote_spawn);
-    } else if (!strcmp(args.mode, "serial_remote_spawn_shallow")) {
-        runtime_assert(data.num_threads >= NODELETS(), "serial_remote_spawn_shallow mode will always use at least one thread per nodelet");
-        RUN_BENCHMARK(global_stream_add_serial_remote_spawn_shallow);
-    } else if (!strcmp(args.mode, "recursive_spawn")) {
-        RUN_BENCHMARK(global_stream_add_recursive_spawn);
-    } else if (!strcmp(args.mode, "recursive_remote_spawn")) {
-        runtime_assert(data.num_threads >= NODELETS(), "recursive_remote_spawn mode will always use at least one thread per nodelet");
-        RUN_BENCHMARK(global_stream_add_recursive_remote_spawn);
-    } else if (!strcmp(args.mode, "library")) {
-        runtime_assert(data.num_threads >= NODELETS(), "emu_for_2d mode will always use at least one thread per nodelet");
-        RUN_BENCHMARK(global_stream_add_library);
-    } else if (!strcmp(args.mode, "serial")) {
-        runtime_assert(data.num_threads == 1, "serial mode can only use one thread");
-        RUN_BENCHMARK(global_stream_add_serial);
-    } else {
-        LOG("Mode %s not implemented!", args.mode);
+    // Benchmark each thread count against the same arrays
+    double results[THREAD_SWEEP_MAX];
+    for (long t = 0; t < args.threads.count; ++t) {
+        long num_threads = args.threads.values[t];
+        mw_replicated_init(&data.num_threads, num_threads);
+        hooks_set_attr_i64("num_threads", num_threads);
+        LOG("Running %s kernel using %s with %li threads\n", stream_kernel_name(args.kernel), args.mode, num_threads);
+
+        double result = 0;
+        #define RUN_BENCHMARK(X) result = global_stream_run(&data, args.mode, X, args.num_trials, args.num_warmup)
+
+        if (!strcmp(args.mode, "first_touch")) {
+            result = global_stream_first_touch_run(&data, args.num_trials, args.num_warmup);
+        } else if (!strcmp(args.mode, "cilk_for")) {
+            RUN_BENCHMARK(global_stream_add_cilk_for);
+        } else if (!strcmp(args.mode, "serial_spawn")) {
+            RUN_BENCHMARK(global_stream_add_serial_spawn);
+        } else if (!strcmp(args.mode, "serial_remote_spawn")) {
+            runtime_assert(data.num_threads >= NODELETS(), "serial_remote_spawn mode will always use at least one thread per nodelet");
+            RUN_BENCHMARK(global_stream_add_serial_remote_spawn);
+        } else if (!strcmp(args.mode, "serial_remote_spawn_shallow")) {
+            runtime_assert(data.num_threads >= NODELETS(), "serial_remote_spawn_shallow mode will always use at least one thread per nodelet");
+            RUN_BENCHMARK(global_stream_add_serial_remote_spawn_shallow);
+        } else if (!strcmp(args.mode, "recursive_spawn")) {
+            RUN_BENCHMARK(global_stream_add_recursive_spawn);
+        } else if (!strcmp(args.mode, "recursive_remote_spawn")) {
+            runtime_assert(data.num_threads >= NODELETS(), "recursive_remote_spawn mode will always use at least one thread per nodelet");
+            RUN_BENCHMARK(global_stream_add_recursive_remote_spawn);
+        } else if (!strcmp(args.mode, "library")) {
+            runtime_assert(data.num_threads >= NODELETS(), "emu_for_2d mode will always use at least one thread per nodelet");
+            RUN_BENCHMARK(global_stream_add_library);
+        } else if (!strcmp(args.mode, "serial")) {
+            runtime_assert(data.num_threads == 1, "serial mode can only use one thread");
+            RUN_BENCHMARK(global_stream_add_serial);
+#ifdef HAVE_STREAM_SIMD
+        } else if (!strcmp(args.mode, "simd")) {
+            runtime_assert(data.num_threads >= NODELETS(), "simd mode will always use at least one thread per nodelet");
+            RUN_BENCHMARK(global_stream_add_simd);
+        } else if (!strcmp(args.mode, "simd_nt")) {
+            runtime_assert(data.num_threads >= NODELETS(), "simd_nt mode will always use at least one thread per nodelet");
+            RUN_BENCHMARK(global_stream_add_simd_nt);
+#endif
+        } else {
+            LOG("Mode %s not implemented!", args.mode);
+            exit(1);
+        }
+        #undef RUN_BENCHMARK
+        results[t] = result;
+    }
+
+    if (args.threads.count > 1) {
+        LOG("Scaling curve for %s (median MB/s):\n", args.mode);
+        for (long t = 0; t < args.threads.count; ++t) {
+            LOG("%8li threads: %3.2f MB/s\n", args.threads.values[t], results[t]);
+        }
     }
 #ifndef NO_VALIDATE
-    LOG("Validating results...");
-    global_stream_validate(&data);
-    LOG("OK\n");
+    // first_touch mode only initializes the arrays, there is no result to check
+    if (strcmp(args.mode, "first_touch")) {
+        LOG("Validating results...");
+        global_stream_validate(&data);
+        LOG("OK\n");
+    }
 #endif
     global_stream_deinit(&data);
     return 0;
@@ -5,9 +5,13 @@
 #include <cilk/cilk.h>
 #include <assert.h>
 #include <string.h>
+#include <getopt.h>
 
 #include <emu_c_utils/emu_c_utils.h>
 #include "common.h"
+#include "benchmark_driver.h"
+#include "thread_sweep.h"
+#include "stream_kernel.h"
 #include "recursive_spawn.h"
 
 typedef struct global_stream_data {
@@ -16,10 +20,12 @@ typedef struct global_stream_data {
     long * c;
     long n;
     long num_threads;
+    // One of the stream_kernel values
+    long kernel;
 } global_stream_data;
 
-#ifndef NO_VALIDATE
-static void init_worker(long * array, long begin, long end, va_list args)
+static void
+first_touch_worker(long * array, long begin, long end, va_list args)
 {
     global_stream_data * data = va_arg(args, global_stream_data *);
     long nodelets = NODELETS();
@@ -29,7 +35,6 @@ static void init_worker(long * array, long begin, long end, va_list args)
         data->c[i] = 0;
     }
 }
-#endif
 
 void
 replicated_init_ptr(long** ptr, long* val)
@@ -37,18 +42,32 @@ replicated_init_ptr(long** ptr, long* val)
     mw_replicated_init((long*)ptr, (long)val);
 }
 
+// Allocates the arrays without touching them
 void
-global_stream_init(global_stream_data * data, long n)
+global_stream_alloc(global_stream_data * data, long n)
 {
     data->n = n;
 
     replicated_init_ptr(&data->a, mw_malloc1dlong(n));
     replicated_init_ptr(&data->b, mw_malloc1dlong(n));
     replicated_init_ptr(&data->c, mw_malloc1dlong(n));
-#ifndef NO_VALIDATE
-    emu_1d_array_apply(data->a, n, GLOBAL_GRAIN(n),
-        init_worker, data
+}
+
+// Writes initial values to each array, using num_threads threads
+void
+global_stream_first_touch(global_stream_data * data)
+{
+    emu_1d_array_apply(data->a, data->n, data->n / data->num_threads,
+        first_touch_worker, data
     );
+}
+
+void
+global_stream_init(global_stream_data * data, long n)
+{
+    global_stream_alloc(data, n);
+#ifndef NO_VALIDATE
+    global_stream_first_touch(data);
 #endif
 }
 
@@ -64,9 +83,10 @@ static void
 global_stream_validate_worker(long * array, long begin, long end, va_list args)
 {
     const long nodelets = NODELETS();
+    long expected = va_arg(args, long);
     for (long i = begin; i < end; i += nodelets) {
-        if (array[i] != 3) {
-            LOG("VALIDATION ERROR: c[%li] == %li (supposed to be 3)\n", i, array[i]);
+        if (array[i] != expected) {
+            LOG("VALIDATION ERROR: c[%li] == %li (supposed to be %li)\n", i, array[i], expected);
             exit(1);
         }
     }
@@ -76,7 +96,7 @@ void
 global_stream_validate(global_stream_data * data)
 {
     emu_1d_array_apply(data->c, data->n, GLOBAL_GRAIN_MIN(data->n, 64),
-        global_stream_validate_worker
+        global_stream_validate_worker, stream_kernel_expected(data->kernel)
     );
 }
 
@@ -85,7 +105,7 @@ void
 global_stream_add_serial(global_stream_data * data)
 {
     for (long i = 0; i < data->n; ++i) {
-        data->c[i] = data->a[i] + data->b[i];
+        STREAM_KERNEL_APPLY(data->kernel, data->c[i], data->a[i], data->b[i]);
     }
 }
 
@@ -97,7 +117,7 @@ global_stream_add_cilk_for(global_stream_data * data)
     #pragma cilk grainsize = data->n / data->num_threads
 #endif
     cilk_for (long i = 0; i < data->n; ++i) {
-        data->c[i] = data->a[i] + data->b[i];
+        STREAM_KERNEL_APPLY(data->kernel, data->c[i], data->a[i], data->b[i]);
     }
 }
 
@@ -105,7 +125,7 @@ noinline void
 serial_spawn_add_worker(long begin, long end, global_stream_data *data)
 {
     for (long i = begin; i < end; ++i) {
-        data->c[i] = data->a[i] + data->b[i];
+        STREAM_KERNEL_APPLY(data->kernel, data->c[i], data->a[i], data->b[i]);
     }
 }
 
@@ -130,7 +150,7 @@ global_stream_add_library_worker(long * array, long begin, long end, va_list arg
     global_stream_data * data = va_arg(args, global_stream_data *);
     const long nodelets = NODELETS();
     for (long i = begin; i < end; i += nodelets) {
-        data->c[i] = data->a[i] + data->b[i];
+        STREAM_KERNEL_APPLY(data->kernel, data->c[i], data->a[i], data->b[i]);
     }
 }
 
@@ -142,21 +162,62 @@ global_stream_add_library(global_stream_data * data)
     );
 }
 
-void global_stream_run(
+double global_stream_run(
     global_stream_data * data,
     const char * name,
     void (*benchmark)(global_stream_data *),
-    long num_trials)
+    long num_trials,
+    long num_warmup)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin(name);
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, name, num_trials,
+        data->n * stream_kernel_bytes_per_element(data->kernel), "MB/s");
+    driver.num_warmup = num_warmup;
+    while (benchmark_driver_next(&driver)) {
+        benchmark_driver_begin_trial(&driver);
         benchmark(data);
-        double time_ms = hooks_region_end();
-        double bytes_per_second = time_ms == 0 ? 0 :
-            (data->n * sizeof(long) * 3) / (time_ms/1000);
-        LOG("%3.2f MB/s\n", bytes_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
+    }
+    benchmark_stats stats = benchmark_driver_finish(&driver);
+    return benchmark_driver_throughput(&driver, stats.median);
+}
+
+// first_touch - time only the initial write to freshly allocated arrays
+double global_stream_first_touch_run(
+    global_stream_data * data,
+    long num_trials,
+    long num_warmup)
+{
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "first_touch", num_trials, data->n * sizeof(long) * 3, "MB/s");
+    driver.num_warmup = num_warmup;
+    while (benchmark_driver_next(&driver)) {
+        // Replace the arrays with allocations that have never been touched
+        global_stream_deinit(data);
+        global_stream_alloc(data, data->n);
+        benchmark_driver_begin_trial(&driver);
+        global_stream_first_touch(data);
+        benchmark_driver_end_trial(&driver);
     }
+    benchmark_stats stats = benchmark_driver_finish(&driver);
+    return benchmark_driver_throughput(&driver, stats.median);
+}
+
+static const struct option long_options[] = {
+    {"warmup"       , required_argument},
+    {"kernel"       , required_argument},
+    {"help"         , no_argument},
+    {NULL}
+};
+
+static void
+print_help(const char* argv0)
+{
+    LOG("Usage: %s [OPTIONS] mode log2_num_elements num_threads num_trials\n", argv0);
+    LOG("\t--warmup             Number of untimed trials to run first\n");
+    LOG("\t--kernel             STREAM kernel to run: copy, scale, add (default), or triad\n");
+    LOG("num_threads can be a list (8,16,32) or a range (8:512:x2, 8:64:+8) to sweep thread counts in one run\n");
+    LOG("\t--help               Print command line help\n");
 }
 
 replicated global_stream_data data;
@@ -166,58 +227,114 @@ int main(int argc, char** argv)
     struct {
         const char* mode;
         long log2_num_elements;
-        long num_threads;
+        thread_sweep threads;
         long num_trials;
+        long num_warmup;
+        long kernel;
     } args;
+    args.num_warmup = 0;
+    args.kernel = STREAM_ADD;
 
-    if (argc != 5) {
-        LOG("Usage: %s mode log2_num_elements num_threads num_trials\n", argv[0]);
+    int option_index;
+    while (true)
+    {
+        int c = getopt_long(argc, argv, "", long_options, &option_index);
+        // Done parsing
+        if (c == -1) { break; }
+        // Parse error
+        if (c == '?') {
+            LOG("Invalid arguments\n");
+            print_help(argv[0]);
+            exit(1);
+        }
+        const char* option_name = long_options[option_index].name;
+
+        if (!strcmp(option_name, "warmup")) {
+            args.num_warmup = atol(optarg);
+        } else if (!strcmp(option_name, "kernel")) {
+            if (!stream_kernel_parse(optarg, &args.kernel)) {
+                LOG("Kernel %s not implemented!\n", optarg);
+                exit(1);
+            }
+        } else if (!strcmp(option_name, "help")) {
+            print_help(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 4) {
+        print_help(argv[0]);
         exit(1);
     } else {
-        args.mode = argv[1];
-        args.log2_num_elements = atol(argv[2]);
-        args.num_threads = atol(argv[3]);
-        args.num_trials = atol(argv[4]);
+        args.mode = argv[optind + 0];
+        args.log2_num_elements = atol(argv[optind + 1]);
+        args.threads = thread_sweep_parse(argv[optind + 2]);
+        args.num_trials = atol(argv[optind + 3]);
 
         if (args.log2_num_elements <= 0) { LOG("log2_num_elements must be > 0"); exit(1); }
-        if (args.num_threads <= 0) { LOG("num_threads must be > 0"); exit(1); }
         if (args.num_trials <= 0) { LOG("num_trials must be > 0"); exit(1); }
+        if (args.num_warmup < 0) { LOG("warmup must be >= 0"); exit(1); }
     }
 
     hooks_set_attr_str("spawn_mode", args.mode);
     hooks_set_attr_i64("log2_num_elements", args.log2_num_elements);
-    hooks_set_attr_i64("num_threads", args.num_threads);
+    hooks_set_attr_i64("num_warmup", args.num_warmup);
+    hooks_set_attr_str("kernel", stream_kernel_name(args.kernel));
     hooks_set_attr_i64("num_nodelets", NODELETS());
-    hooks_set_attr_i64("num_bytes_per_element", sizeof(long) * 3);
+    hooks_set_attr_i64("num_bytes_per_element", stream_kernel_bytes_per_element(args.kernel));
 
     long n = 1L << args.log2_num_elements;
     long mbytes = n * sizeof(long) / (1024*1024);
     long mbytes_per_nodelet = mbytes / NODELETS();
     LOG("Initializing arrays with %li elements each (%li MiB total, %li MiB per nodelet)\n", 3 * n, 3 * mbytes, 3 * mbytes_per_nodelet);
     fflush(stdout);
-    data.num_threads = args.num_threads;
+    data.num_threads = args.threads.values[0];
+    mw_replicated_init(&data.kernel, args.kernel);
     global_stream_init(&data, n);
-    LOG("Doing vector addition using %s\n", args.mode); fflush(stdout);
-
-    #define RUN_BENCHMARK(X) global_stream_run(&data, args.mode, X, args.num_trials)
-
-    if (!strcmp(args.mode, "cilk_for")) {
-        RUN_BENCHMARK(global_stream_add_cilk_for);
-    } else if (!strcmp(args.mode, "serial_spawn")) {
-        RUN_BENCHMARK(global_stream_add_serial_spawn);
-    } else if (!strcmp(args.mode, "library")) {
-        runtime_assert(data.num_threads >= NODELETS(), "will always use at least one thread per nodelet");
-        RUN_BENCHMARK(global_stream_add_library);
-    } else if (!strcmp(args.mode, "serial")) {
-        runtime_assert(data.num_threads == 1, "serial mode can only use one thread");
-        RUN_BENCHMARK(global_stream_add_serial);
-    } else {
-        LOG("Mode %s not implemented!", args.mode);
+    // Benchmark each thread count against the same arrays
+    double results[THREAD_SWEEP_MAX];
+    for (long t = 0; t < args.threads.count; ++t) {
+        long num_threads = args.threads.values[t];
+        mw_replicated_init(&data.num_threads, num_threads);
+        hooks_set_attr_i64("num_threads", num_threads);
+        LOG("Running %s kernel using %s with %li threads\n", stream_kernel_name(args.kernel), args.mode, num_threads);
+
+        double result = 0;
+        #define RUN_BENCHMARK(X) result = global_stream_run(&data, args.mode, X, args.num_trials, args.num_warmup)
+
+        if (!strcmp(args.mode, "first_touch")) {
+            result = global_stream_first_touch_run(&data, args.num_trials, args.num_warmup);
+        } else if (!strcmp(args.mode, "cilk_for")) {
+            RUN_BENCHMARK(global_stream_add_cilk_for);
+        } else if (!strcmp(args.mode, "serial_spawn")) {
+            RUN_BENCHMARK(global_stream_add_serial_spawn);
+        } else if (!strcmp(args.mode, "library")) {
+            runtime_assert(data.num_threads >= NODELETS(), "will always use at least one thread per nodelet");
+            RUN_BENCHMARK(global_stream_add_library);
+        } else if (!strcmp(args.mode, "serial")) {
+            runtime_assert(data.num_threads == 1, "serial mode can only use one thread");
+            RUN_BENCHMARK(global_stream_add_serial);
+        } else {
+            LOG("Mode %s not implemented!", args.mode);
+            exit(1);
+        }
+        #undef RUN_BENCHMARK
+        results[t] = result;
+    }
+
+    if (args.threads.count > 1) {
+        LOG("Scaling curve for %s (median MB/s):\n", args.mode);
+        for (long t = 0; t < args.threads.count; ++t) {
+            LOG("%8li threads: %3.2f MB/s\n", args.threads.values[t], results[t]);
+        }
     }
 #ifndef NO_VALIDATE
-    LOG("Validating results...");
-    global_stream_validate(&data);
-    LOG("OK\n");
+    // first_touch mode only initializes the arrays, there is no result to check
+    if (strcmp(args.mode, "first_touch")) {
+        LOG("Validating results...");
+        global_stream_validate(&data);
+        LOG("OK\n");
+    }
 #endif
 
     global_stream_deinit(&data);
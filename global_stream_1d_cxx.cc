@@ -13,6 +13,7 @@
 #include <emu_cxx_utils/repl_array.h>
 #include <emu_cxx_utils/for_each.h>
 #include "common.h"
+#include "benchmark_driver.h"
 
 using namespace emu;
 
@@ -131,17 +132,16 @@ struct global_stream_1d
     run(const char * name, long num_trials)
     {
         LOG("In run(%s, %li)\n", name, num_trials);
-        for (long trial = 0; trial < num_trials; ++trial) {
-            hooks_set_attr_i64("trial", trial);
-
-            #define RUN_BENCHMARK(X)            \
-            do {                                \
-                hooks_region_begin(name);       \
-                X();                            \
-                time_ms = hooks_region_end();   \
+        benchmark_driver driver;
+        benchmark_driver_init(&driver, name, num_trials, n * sizeof(long) * 3, "MB/s");
+        while (benchmark_driver_next(&driver)) {
+            #define RUN_BENCHMARK(X)                    \
+            do {                                        \
+                benchmark_driver_begin_trial(&driver);  \
+                X();                                    \
+                benchmark_driver_end_trial(&driver);    \
             } while(false)
 
-            double time_ms = 0;
             if (!strcmp(name, "serial")) {
                 RUN_BENCHMARK(add_serial);
             } else if (!strcmp(name, "cilk_for")) {
@@ -162,10 +162,8 @@ struct global_stream_1d
             }
 
             #undef RUN_BENCHMARK
-            double mbytes_per_second = (1e-6 * n * sizeof(long) * 3)
-                                       / (1e-3 * time_ms);
-            LOG("%3.2f MB/s\n", mbytes_per_second);
         }
+        benchmark_driver_finish(&driver);
     }
 };
 
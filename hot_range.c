@@ -10,12 +10,36 @@
 #include <emu_c_utils/emu_c_utils.h>
 
 #include "common.h"
+#include "benchmark_driver.h"
+#include "index_generator.h"
 
 enum op_mode {
     OP_REMOTE_WRITE,
     OP_REMOTE_ADD,
     OP_ATOMIC_ADD,
     OP_ATOMIC_CAS,
+    OP_COMBINED_ADD,
+    // Atomic add that uses the old value (i.e. a ticket counter)
+    OP_FETCH_ADD,
+    // Min/max with a CAS loop
+    OP_ATOMIC_MIN,
+    OP_ATOMIC_MAX,
+    // Min/max with the native memory-side operation (no return value)
+    OP_REMOTE_MIN,
+    OP_REMOTE_MAX,
+    OP_ATOMIC_OR,
+};
+
+// How the target array is allocated
+enum array_layout {
+    // mw_malloc1dlong, consecutive elements on consecutive nodelets
+    LAYOUT_STRIPED,
+    // mw_malloc2d, one block of n / NODELETS() elements on each nodelet
+    LAYOUT_CHUNKED,
+    // mw_localmalloc, all elements on nodelet 0
+    LAYOUT_LOCAL,
+    // mw_mallocrepl, each nodelet updates its own copy of the array
+    LAYOUT_REPLICATED,
 };
 
 typedef struct hot_range_data {
@@ -24,21 +48,60 @@ typedef struct hot_range_data {
     // Number of threads
     long num_threads;
     // Parameters for list initialization
-    // For all i, operate on (i + offset) % length
+    // For all i, operate on (offset + sample(i)) % n, where sample(i) is in [0, length)
     long offset;
     long length;
+    // Distribution of sample(i), cyclic by default (sample(i) = i % length)
+    index_generator generator;
+    // Final value of each element, for distributions other than cyclic and ops other than writes and adds
+    long * expected_values;
+    // Fetch-add mode: sum of the values returned by every fetch-add, and the expected sum
+    long fetch_sum;
+    long expected_fetch_sum;
 
     // Operation to perform on each element of the array
     enum op_mode op_mode;
+    // One of the array_layout values
+    long layout;
 
-    // Target array for all operations
+    // Target array for all operations (striped, local and replicated layouts)
     long * array;
-    // Specifies which array elements should be targeted by each thread
+    // Target array for all operations (chunked layout), each chunk has 2^log2_chunk_size elements
+    long ** chunks;
+    long log2_chunk_size;
+    // Specifies which array elements should be targeted by each thread, as indices into the target array
+    // Always striped, so that the threads are spread across all nodelets regardless of the layout
     long * indices;
 } hot_range_data;
 
 replicated hot_range_data data;
 
+// Fields that locate the target array, copied onto the stack at the start of each worker
+typedef struct hot_range_view {
+    long layout;
+    long * array;
+    long ** chunks;
+    long log2_chunk_size;
+} hot_range_view;
+
+static inline hot_range_view
+hot_range_get_view(void)
+{
+    hot_range_view view = { data.layout, data.array, data.chunks, data.log2_chunk_size };
+    return view;
+}
+
+// Address of an element of the target array. The layout is loop-invariant in every caller.
+static inline long *
+hot_range_element(const hot_range_view * view, long index)
+{
+    if (view->layout == LAYOUT_CHUNKED) {
+        return &view->chunks[index >> view->log2_chunk_size][index & ((1L << view->log2_chunk_size) - 1)];
+    }
+    // A replicated address resolves to the copy on the nodelet where the thread is running
+    return &view->array[index];
+}
+
 void
 clear_array_worker(long * array, long begin, long end, va_list args)
 {
@@ -50,7 +113,55 @@ clear_array_worker(long * array, long begin, long end, va_list args)
 void
 hot_range_clear_array(hot_range_data * data)
 {
-    emu_1d_array_apply(data->array, data->n, GLOBAL_GRAIN_MIN(data->n, 128), clear_array_worker);
+    switch (data->layout) {
+        case LAYOUT_STRIPED:
+            emu_1d_array_apply(data->array, data->n, GLOBAL_GRAIN_MIN(data->n, 128), clear_array_worker);
+            break;
+        case LAYOUT_CHUNKED:
+            for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+                cilk_spawn_at(data->chunks[nlet]) memset(data->chunks[nlet], 0, sizeof(long) << data->log2_chunk_size);
+            }
+            cilk_sync;
+            break;
+        case LAYOUT_LOCAL:
+            memset(data->array, 0, data->n * sizeof(long));
+            break;
+        case LAYOUT_REPLICATED:
+            for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+                long * copy = mw_get_nth(data->array, nlet);
+                cilk_spawn_at(copy) memset(copy, 0, data->n * sizeof(long));
+            }
+            cilk_sync;
+            break;
+    }
+    mw_replicated_init(&data->fetch_sum, 0);
+}
+
+// Operand of the i'th operation for min, max and or, chosen so that the final values depend on every operation
+// The array starts out zeroed, so min uses negative values
+static inline long
+hot_range_op_value(long op_mode, long i)
+{
+    switch (op_mode) {
+        case OP_ATOMIC_MIN:
+        case OP_REMOTE_MIN: return -(i + 1);
+        case OP_ATOMIC_OR:  return (long)(1UL << (i % 64));
+        default:            return i + 1;
+    }
+}
+
+// True if the final value of each element only depends on how many times it is targeted
+static inline bool
+hot_range_op_counts(long op_mode)
+{
+    switch (op_mode) {
+        case OP_REMOTE_WRITE:
+        case OP_REMOTE_ADD:
+        case OP_ATOMIC_ADD:
+        case OP_ATOMIC_CAS:
+        case OP_COMBINED_ADD: return true;
+        default:              return false;
+    }
 }
 
 static inline long
@@ -59,36 +170,121 @@ transform_1d_index(long i, long n)
     return ((i * NODELETS()) & (n-1)) + ((i * NODELETS()) >> PRIORITY(n));
 }
 
+// Inverse of transform_1d_index
+static inline long
+logical_1d_index(long physical, long n)
+{
+    return (physical % NODELETS()) * (n / NODELETS()) + physical / NODELETS();
+}
+
+// Index of element i in the target array
+// In the striped layout, this puts contiguous elements on the same nodelet, as in the chunked layout
+static inline long
+hot_range_layout_index(long layout, long i, long n)
+{
+    return layout == LAYOUT_STRIPED ? transform_1d_index(i, n) : i;
+}
+
+// Inverse of hot_range_layout_index
+static inline long
+hot_range_element_number(long layout, long index, long n)
+{
+    return layout == LAYOUT_STRIPED ? logical_1d_index(index, n) : index;
+}
+
+// Nodelet that holds an element of the target array, when accessed from src_nlet
+static inline long
+hot_range_nodelet_of(const hot_range_data * data, long index, long src_nlet)
+{
+    switch (data->layout) {
+        case LAYOUT_STRIPED: return index % NODELETS();
+        case LAYOUT_CHUNKED: return index >> data->log2_chunk_size;
+        case LAYOUT_LOCAL:   return 0;
+        default:             return src_nlet;
+    }
+}
+
 void
 index_init_worker(long * indices, long begin, long end, va_list args) {
     const long n = data.n;
     const long offset = data.offset;
-    const long length = data.length;
+    const index_generator * generator = &data.generator;
     for (long i = begin; i < end; i += NODELETS()) {
         // Map onto a 'length'-sized chunk of the array, 'offset' elements from the start
         // If offset + length > n, the hot range will be split between the first and last nodelets
-        long target = (offset + (i % length)) % n;
+        long target = (offset + index_generator_sample(generator, i)) % n;
         // Transform to account for striped indexing
-        target = transform_1d_index(target, n);
+        target = hot_range_layout_index(data.layout, target, n);
         indices[i] = target;
     }
 }
 
+// Computes the final value of each element, by replaying the index stream on one thread
+static long *
+hot_range_expected_values(hot_range_data * data, long op_mode)
+{
+    long * values = calloc(data->n, sizeof(long));
+    runtime_assert(values != NULL, "Failed to allocate array for validation");
+    for (long i = 0; i < data->n; ++i) {
+        long * value = &values[(data->offset + index_generator_sample(&data->generator, i)) % data->n];
+        long operand = hot_range_op_value(op_mode, i);
+        switch (op_mode) {
+            case OP_REMOTE_WRITE: *value = 1; break;
+            case OP_ATOMIC_MIN:
+            case OP_REMOTE_MIN: if (operand < *value) { *value = operand; } break;
+            case OP_ATOMIC_MAX:
+            case OP_REMOTE_MAX: if (operand > *value) { *value = operand; } break;
+            case OP_ATOMIC_OR: *value |= operand; break;
+            default: *value += 1; break;
+        }
+    }
+    return values;
+}
+
 void
-hot_range_data_init(hot_range_data * data, long n, enum op_mode op_mode, long offset, long length, long num_threads)
+hot_range_data_init(hot_range_data * data, long n, enum op_mode op_mode, long layout, long offset, long length, long num_threads,
+    const index_generator * generator)
 {
     // Initialize parameters
     mw_replicated_init(&data->n, n);
     mw_replicated_init((long*)&data->op_mode, op_mode);
+    mw_replicated_init(&data->layout, layout);
     mw_replicated_init(&data->offset, offset);
     mw_replicated_init(&data->length, length);
     mw_replicated_init(&data->num_threads, num_threads);
+    for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+        hot_range_data * remote_data = mw_get_nth(data, nlet);
+        memcpy(&remote_data->generator, generator, sizeof(index_generator));
+    }
+    mw_replicated_init((long*)&data->expected_values, 0);
+    mw_replicated_init(&data->expected_fetch_sum, 0);
 
     // Allocate arrays
-    long * array = mw_malloc1dlong((size_t)n);
+    long * array = NULL;
+    long ** chunks = NULL;
+    long log2_chunk_size = 0;
+    switch (layout) {
+        case LAYOUT_STRIPED:
+            array = mw_malloc1dlong((size_t)n);
+            break;
+        case LAYOUT_CHUNKED:
+            runtime_assert(n >= NODELETS(), "Chunked layout needs at least one element per nodelet");
+            log2_chunk_size = PRIORITY(n / NODELETS());
+            chunks = (long**)mw_malloc2d(NODELETS(), sizeof(long) << log2_chunk_size);
+            array = (long*)chunks;
+            break;
+        case LAYOUT_LOCAL:
+            array = mw_localmalloc(n * sizeof(long), data);
+            break;
+        case LAYOUT_REPLICATED:
+            array = mw_mallocrepl(n * sizeof(long));
+            break;
+    }
     long * indices = mw_malloc1dlong((size_t)n);
     runtime_assert(array && indices, "Failed to allocate array");
-    mw_replicated_init((long*)&data->array, (long)array);
+    mw_replicated_init((long*)&data->array, layout == LAYOUT_CHUNKED ? 0 : (long)array);
+    mw_replicated_init((long*)&data->chunks, (long)chunks);
+    mw_replicated_init(&data->log2_chunk_size, log2_chunk_size);
     mw_replicated_init((long*)&data->indices, (long)indices);
 
     // Set up the list
@@ -99,43 +295,126 @@ hot_range_data_init(hot_range_data * data, long n, enum op_mode op_mode, long of
 #ifndef NO_VALIDATE
     // Initialize the array with zeros
     hot_range_clear_array(data);
+    // There is no closed form for the number of hits per element with random distributions,
+    // or for the final values of min, max and or
+    if (generator->distribution != INDEX_DIST_CYCLIC || !hot_range_op_counts(op_mode)) {
+        long * expected_values = hot_range_expected_values(data, op_mode);
+        mw_replicated_init((long*)&data->expected_values, (long)expected_values);
+        // An element targeted k times returns 0, 1, ..., k-1 from its fetch-adds
+        long expected_fetch_sum = 0;
+        for (long i = 0; i < n; ++i) {
+            expected_fetch_sum += expected_values[i] * (expected_values[i] - 1) / 2;
+        }
+        mw_replicated_init(&data->expected_fetch_sum, expected_fetch_sum);
+    }
 #endif
 }
 
 void
-hot_range_remote_write_worker(long * array, long begin, long end, va_list args)
+hot_range_remote_write_worker(long * indices, long begin, long end, va_list args)
+{
+    const hot_range_view view = hot_range_get_view();
+    for (long i = begin; i < end; i += NODELETS()) {
+        *hot_range_element(&view, indices[i]) = 1;
+    }
+}
+
+void
+hot_range_remote_add_worker(long * indices, long begin, long end, va_list args)
+{
+    const hot_range_view view = hot_range_get_view();
+    for (long i = begin; i < end; i += NODELETS()) {
+        REMOTE_ADD(hot_range_element(&view, indices[i]), 1);
+    }
+}
+
+void
+hot_range_atomic_add_worker(long * indices, long begin, long end, va_list args)
+{
+    const hot_range_view view = hot_range_get_view();
+    for (long i = begin; i < end; i += NODELETS()) {
+        ATOMIC_ADDMS(hot_range_element(&view, indices[i]), 1);
+    }
+}
+
+void
+hot_range_fetch_add_worker(long * indices, long begin, long end, va_list args)
 {
-    long * indices = data.indices;
+    const hot_range_view view = hot_range_get_view();
+    long local_sum = 0;
     for (long i = begin; i < end; i += NODELETS()) {
-        array[indices[i]] = 1;
+        // Using the result means waiting for the round trip
+        local_sum += ATOMIC_ADDMS(hot_range_element(&view, indices[i]), 1);
     }
+    REMOTE_ADD(&data.fetch_sum, local_sum);
 }
 
 void
-hot_range_remote_add_worker(long * array, long begin, long end, va_list args)
+hot_range_atomic_min_worker(long * indices, long begin, long end, va_list args)
 {
-    long * indices = data.indices;
+    const hot_range_view view = hot_range_get_view();
     for (long i = begin; i < end; i += NODELETS()) {
-        REMOTE_ADD(&array[indices[i]], 1);
+        long value = hot_range_op_value(OP_ATOMIC_MIN, i);
+        long * target = hot_range_element(&view, indices[i]);
+        long oldval = *target;
+        while (value < oldval) {
+            long seen = ATOMIC_CAS(target, value, oldval);
+            if (seen == oldval) { break; }
+            oldval = seen;
+        }
     }
 }
 
 void
-hot_range_atomic_add_worker(long * array, long begin, long end, va_list args)
+hot_range_atomic_max_worker(long * indices, long begin, long end, va_list args)
 {
-    long * indices = data.indices;
+    const hot_range_view view = hot_range_get_view();
     for (long i = begin; i < end; i += NODELETS()) {
-        ATOMIC_ADDMS(&array[indices[i]], 1);
+        long value = hot_range_op_value(OP_ATOMIC_MAX, i);
+        long * target = hot_range_element(&view, indices[i]);
+        long oldval = *target;
+        while (value > oldval) {
+            long seen = ATOMIC_CAS(target, value, oldval);
+            if (seen == oldval) { break; }
+            oldval = seen;
+        }
     }
 }
 
 void
-hot_range_atomic_cas_worker(long * array, long begin, long end, va_list args)
+hot_range_remote_min_worker(long * indices, long begin, long end, va_list args)
 {
-    long * indices = data.indices;
+    const hot_range_view view = hot_range_get_view();
+    for (long i = begin; i < end; i += NODELETS()) {
+        REMOTE_MIN(hot_range_element(&view, indices[i]), hot_range_op_value(OP_REMOTE_MIN, i));
+    }
+}
+
+void
+hot_range_remote_max_worker(long * indices, long begin, long end, va_list args)
+{
+    const hot_range_view view = hot_range_get_view();
+    for (long i = begin; i < end; i += NODELETS()) {
+        REMOTE_MAX(hot_range_element(&view, indices[i]), hot_range_op_value(OP_REMOTE_MAX, i));
+    }
+}
+
+void
+hot_range_atomic_or_worker(long * indices, long begin, long end, va_list args)
+{
+    const hot_range_view view = hot_range_get_view();
+    for (long i = begin; i < end; i += NODELETS()) {
+        ATOMIC_ORMS(hot_range_element(&view, indices[i]), hot_range_op_value(OP_ATOMIC_OR, i));
+    }
+}
+
+void
+hot_range_atomic_cas_worker(long * indices, long begin, long end, va_list args)
+{
+    const hot_range_view view = hot_range_get_view();
     for (long i = begin; i < end; i += NODELETS()) {
         long oldval, newval;
-        long * target = &array[indices[i]];
+        long * target = hot_range_element(&view, indices[i]);
         do {
             oldval = *target;
             newval = oldval + 1;
@@ -143,6 +422,56 @@ hot_range_atomic_cas_worker(long * array, long begin, long end, va_list args)
     }
 }
 
+/*
+ * Software combining: each thread sums its updates to the same element in a small open-addressing
+ * table, and only issues one REMOTE_ADD per distinct target when the table fills up or the thread is done.
+ * The table lives on the thread's stack, which is small on Emu, so it only holds a few entries.
+ */
+#define COMBINE_TABLE_LOG2_SIZE 7
+#define COMBINE_TABLE_SIZE (1L << COMBINE_TABLE_LOG2_SIZE)
+// Flush when the table is 3/4 full, so probe sequences stay short
+#define COMBINE_TABLE_MAX_LOAD (COMBINE_TABLE_SIZE * 3 / 4)
+
+static inline void
+combine_table_flush(const hot_range_view * view, long * keys, long * counts)
+{
+    for (long slot = 0; slot < COMBINE_TABLE_SIZE; ++slot) {
+        if (keys[slot] >= 0) {
+            REMOTE_ADD(hot_range_element(view, keys[slot]), counts[slot]);
+            keys[slot] = -1;
+        }
+    }
+}
+
+void
+hot_range_combined_add_worker(long * indices, long begin, long end, va_list args)
+{
+    const hot_range_view view = hot_range_get_view();
+    long keys[COMBINE_TABLE_SIZE];
+    long counts[COMBINE_TABLE_SIZE];
+    for (long slot = 0; slot < COMBINE_TABLE_SIZE; ++slot) { keys[slot] = -1; }
+    long num_used = 0;
+    for (long i = begin; i < end; i += NODELETS()) {
+        long target = indices[i];
+        // Fibonacci hashing, then linear probing
+        long slot = (long)(((unsigned long)target * 0x9E3779B97F4A7C15UL) >> (64 - COMBINE_TABLE_LOG2_SIZE));
+        while (keys[slot] >= 0 && keys[slot] != target) {
+            slot = (slot + 1) & (COMBINE_TABLE_SIZE - 1);
+        }
+        if (keys[slot] == target) {
+            counts[slot] += 1;
+        } else {
+            keys[slot] = target;
+            counts[slot] = 1;
+            if (++num_used == COMBINE_TABLE_MAX_LOAD) {
+                combine_table_flush(&view, keys, counts);
+                num_used = 0;
+            }
+        }
+    }
+    combine_table_flush(&view, keys, counts);
+}
+
 void
 hot_range_launch(hot_range_data * data)
 {
@@ -152,17 +481,29 @@ hot_range_launch(hot_range_data * data)
         case OP_ATOMIC_ADD: worker_ptr = hot_range_atomic_add_worker; break;
         case OP_ATOMIC_CAS: worker_ptr = hot_range_atomic_cas_worker; break;
         case OP_REMOTE_ADD: worker_ptr = hot_range_remote_add_worker; break;
+        case OP_COMBINED_ADD: worker_ptr = hot_range_combined_add_worker; break;
+        case OP_FETCH_ADD: worker_ptr = hot_range_fetch_add_worker; break;
+        case OP_ATOMIC_MIN: worker_ptr = hot_range_atomic_min_worker; break;
+        case OP_ATOMIC_MAX: worker_ptr = hot_range_atomic_max_worker; break;
+        case OP_REMOTE_MIN: worker_ptr = hot_range_remote_min_worker; break;
+        case OP_REMOTE_MAX: worker_ptr = hot_range_remote_max_worker; break;
+        case OP_ATOMIC_OR: worker_ptr = hot_range_atomic_or_worker; break;
         case OP_REMOTE_WRITE: worker_ptr = hot_range_remote_write_worker; break;
         default: assert(0);
     }
-    emu_1d_array_apply(data->array, data->n, grain, worker_ptr);
+    emu_1d_array_apply(data->indices, data->n, grain, worker_ptr);
 }
 
 void
 hot_range_data_deinit(hot_range_data * data)
 {
-    mw_free(data->array);
+    switch (data->layout) {
+        case LAYOUT_CHUNKED: mw_free(data->chunks); break;
+        case LAYOUT_LOCAL: mw_localfree(data->array); break;
+        default: mw_free(data->array); break;
+    }
     mw_free(data->indices);
+    free(data->expected_values);
 }
 
 void
@@ -174,17 +515,44 @@ check_value(long i, long actual, long expected)
     }
 }
 
+// Value of element i of the target array
+// In the replicated layout, each nodelet updates its own copy, so the copies are combined
+static long
+hot_range_read_element(long i)
+{
+    const hot_range_view view = hot_range_get_view();
+    long * element = hot_range_element(&view, hot_range_layout_index(view.layout, i, data.n));
+    if (view.layout != LAYOUT_REPLICATED) { return *element; }
+    long value = 0;
+    for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+        long copy = *(long*)mw_get_nth(element, nlet);
+        switch (data.op_mode) {
+            case OP_REMOTE_WRITE:
+            case OP_ATOMIC_MAX:
+            case OP_REMOTE_MAX: if (copy > value) { value = copy; } break;
+            case OP_ATOMIC_MIN:
+            case OP_REMOTE_MIN: if (copy < value) { value = copy; } break;
+            case OP_ATOMIC_OR: value |= copy; break;
+            default: value += copy; break;
+        }
+    }
+    return value;
+}
+
 void
-validate_worker(long * array, long begin, long end, va_list args)
+validate_worker(long * indices, long begin, long end, va_list args)
 {
     long n = data.n;
     long hot_range_begin = data.offset;
-    long hot_range_end = data.offset + data.length;
-    long hot_range_length = hot_range_end - hot_range_begin;
+    long hot_range_length = data.length;
 
     for (long i = begin; i < end; i += NODELETS()) {
         long expected_value;
-        if (i < hot_range_begin || i >= hot_range_end) {
+        // Position of i in the hot range, which wraps around to the start of the array if offset + length > n
+        long pos = (i - hot_range_begin + n) % n;
+        if (data.expected_values != NULL) {
+            expected_value = data.expected_values[i];
+        } else if (pos >= hot_range_length) {
             // Values outside the hot range should not be touched
             expected_value = 0;
         } else  {
@@ -195,37 +563,150 @@ validate_worker(long * array, long begin, long end, va_list args)
                 // Each value will have been incremented n / length times
                 expected_value = n / hot_range_length;
                 // If it doesn't divide evenly, some items will be incremented more than others
-                if ((i - hot_range_begin) < (n % hot_range_length)) {
+                if (pos < (n % hot_range_length)) {
                     expected_value += 1;
                 }
             }
         }
-        long physical_index = transform_1d_index(i, n);
-        check_value(i, array[physical_index], expected_value);
+        check_value(i, hot_range_read_element(i), expected_value);
     }
 }
 
 void
 hot_range_validate(hot_range_data * data)
 {
-    emu_1d_array_apply(data->array, data->n, GLOBAL_GRAIN_MIN(data->n, 128), validate_worker);
+    emu_1d_array_apply(data->indices, data->n, GLOBAL_GRAIN_MIN(data->n, 128), validate_worker);
+    // With a replicated array, tickets are handed out separately by each copy
+    if (data->op_mode == OP_FETCH_ADD && data->layout != LAYOUT_REPLICATED) {
+        // Each element hands out every ticket exactly once
+        long fetch_sum = 0;
+        for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+            fetch_sum += *(long*)mw_get_nth(&data->fetch_sum, nlet);
+        }
+        if (fetch_sum != data->expected_fetch_sum) {
+            LOG("Error in validation, fetch-adds returned a total of %li, expected %li\n", fetch_sum, data->expected_fetch_sum);
+            exit(1);
+        }
+    }
 }
 
-void hot_range_run(hot_range_data * data, long num_trials)
+benchmark_stats
+hot_range_run(hot_range_data * data, long num_trials)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin("hot_range");
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "hot_range", num_trials, data->n, "million operations per second");
+    while (benchmark_driver_next(&driver)) {
+        benchmark_driver_begin_trial(&driver);
         hot_range_launch(data);
-        double time_ms = hooks_region_end();
+        benchmark_driver_end_trial(&driver);
 #ifndef NO_VALIDATE
         hot_range_validate(data);
         hot_range_clear_array(data);
 #endif
-        double ops_per_second = time_ms == 0 ? 0 :
-            (data->n) / (time_ms/1000);
-        LOG("%3.2f million operations per second\n", ops_per_second / (1000000));
     }
+    return benchmark_driver_finish(&driver);
+}
+
+// Nodelet that holds an element, or -1 if there is a copy on every nodelet
+static inline long
+hot_range_element_nodelet(const hot_range_data * data, long index)
+{
+    return data->layout == LAYOUT_REPLICATED ? -1 : hot_range_nodelet_of(data, index, 0);
+}
+
+/*
+ * Instrumentation mode: counts where the operations of each trial land, by scanning the index array
+ * after the timed trials (so the counting does not perturb the timing).
+ * Writes a matrix of operations from each source nodelet (where the thread issuing the operation runs)
+ * to each destination nodelet (where the target element lives), and the top_k most targeted elements.
+ * The file is JSON if the name ends in .json, and CSV otherwise.
+ */
+void
+hot_range_write_heatmap(hot_range_data * data, const char * filename, long top_k,
+    const char * op_mode, double time_ms, double mops)
+{
+    const long n = data->n;
+    const long num_nodelets = NODELETS();
+    long * nodelet_ops = calloc(num_nodelets * num_nodelets, sizeof(long));
+    long * element_ops = calloc(n, sizeof(long));
+    long * top_elements = calloc(top_k, sizeof(long));
+    runtime_assert(nodelet_ops && element_ops && top_elements, "Failed to allocate arrays for heatmap");
+
+    for (long i = 0; i < n; ++i) {
+        long target = data->indices[i];
+        // Each operation is issued from the nodelet that holds its entry in the (striped) index array
+        long src = i % num_nodelets;
+        nodelet_ops[src * num_nodelets + hot_range_nodelet_of(data, target, src)] += 1;
+        element_ops[target] += 1;
+    }
+
+    // Keep the top_k elements sorted by decreasing count (insertion sort, top_k is small)
+    long num_top = 0;
+    for (long e = 0; e < n; ++e) {
+        if (element_ops[e] == 0) { continue; }
+        if (num_top == top_k && element_ops[e] <= element_ops[top_elements[top_k - 1]]) { continue; }
+        long pos = num_top < top_k ? num_top++ : top_k - 1;
+        for (; pos > 0 && element_ops[top_elements[pos - 1]] < element_ops[e]; --pos) {
+            top_elements[pos] = top_elements[pos - 1];
+        }
+        top_elements[pos] = e;
+    }
+
+    // Summarize the load on each destination nodelet in the log
+    long max_ops = 0;
+    for (long dst = 0; dst < num_nodelets; ++dst) {
+        long ops = 0;
+        for (long src = 0; src < num_nodelets; ++src) { ops += nodelet_ops[src * num_nodelets + dst]; }
+        if (ops > max_ops) { max_ops = ops; }
+    }
+    LOG("Busiest nodelet receives %li of %li operations (%3.2fx the mean)\n",
+        max_ops, n, (double)max_ops * num_nodelets / n);
+
+    FILE * fp = fopen(filename, "w");
+    runtime_assert(fp != NULL, "Failed to open heatmap file");
+    size_t len = strlen(filename);
+    bool json = len >= 5 && !strcmp(filename + len - 5, ".json");
+    if (json) {
+        fprintf(fp, "{\n  \"benchmark\": \"hot_range\",\n  \"op_mode\": \"%s\",\n", op_mode);
+        fprintf(fp, "  \"num_elements\": %li,\n  \"num_nodelets\": %li,\n", n, num_nodelets);
+        fprintf(fp, "  \"median_time_ms\": %f,\n  \"median_mops\": %f,\n", time_ms, mops);
+        fprintf(fp, "  \"nodelet_ops\": [\n");
+        for (long src = 0; src < num_nodelets; ++src) {
+            fprintf(fp, "    [");
+            for (long dst = 0; dst < num_nodelets; ++dst) {
+                fprintf(fp, "%s%li", dst ? ", " : "", nodelet_ops[src * num_nodelets + dst]);
+            }
+            fprintf(fp, "]%s\n", src < num_nodelets - 1 ? "," : "");
+        }
+        fprintf(fp, "  ],\n  \"top_elements\": [\n");
+        for (long k = 0; k < num_top; ++k) {
+            long e = top_elements[k];
+            fprintf(fp, "    {\"element\": %li, \"nodelet\": %li, \"ops\": %li}%s\n",
+                hot_range_element_number(data->layout, e, n), hot_range_element_nodelet(data, e), element_ops[e],
+                k < num_top - 1 ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+    } else {
+        fprintf(fp, "# hot_range op_mode=%s num_elements=%li num_nodelets=%li median_time_ms=%f median_mops=%f\n",
+            op_mode, n, num_nodelets, time_ms, mops);
+        fprintf(fp, "kind,src_nodelet,dst_nodelet,element,ops\n");
+        for (long src = 0; src < num_nodelets; ++src) {
+            for (long dst = 0; dst < num_nodelets; ++dst) {
+                fprintf(fp, "nodelet,%li,%li,,%li\n", src, dst, nodelet_ops[src * num_nodelets + dst]);
+            }
+        }
+        for (long k = 0; k < num_top; ++k) {
+            long e = top_elements[k];
+            fprintf(fp, "element,,%li,%li,%li\n", hot_range_element_nodelet(data, e),
+                hot_range_element_number(data->layout, e, n), element_ops[e]);
+        }
+    }
+    fclose(fp);
+    LOG("Wrote heatmap to %s\n", filename);
+
+    free(top_elements);
+    free(element_ops);
+    free(nodelet_ops);
 }
 
 static const struct option long_options[] = {
@@ -235,6 +716,14 @@ static const struct option long_options[] = {
     {"log2_offset"       , required_argument},
     {"log2_length"       , required_argument},
     {"num_trials"        , required_argument},
+    {"distribution"      , required_argument},
+    {"alpha"             , required_argument},
+    {"rmat"              , required_argument},
+    {"replay_file"       , required_argument},
+    {"seed"              , required_argument},
+    {"heatmap"           , required_argument},
+    {"top_k"             , required_argument},
+    {"layout"            , required_argument},
     {"help"              , no_argument},
     {NULL}
 };
@@ -245,10 +734,19 @@ print_help(const char* argv0)
     LOG( "Usage: %s [OPTIONS]\n", argv0);
     LOG("\t--log2_num_elements  Number of elements in the array\n");
     LOG("\t--num_threads        Number of threads scanning the array\n");
-    LOG("\t--op_mode            Which operation to do on each element (REMOTE_WRITE, REMOTE_ADD, or ATOMIC_ADD)\n");
+    LOG("\t--op_mode            Which operation to do on each element (REMOTE_WRITE, REMOTE_ADD, ATOMIC_ADD, ATOMIC_CAS,\n"
+        "\t                     COMBINED_ADD, FETCH_ADD, ATOMIC_MIN, ATOMIC_MAX, REMOTE_MIN, REMOTE_MAX, or ATOMIC_OR)\n");
     LOG("\t--log2_offset        Offset of the hot range from the beginning of the array\n");
     LOG("\t--log2_length        Number of elements in the hot range.\n");
     LOG("\t--num_trials         Number of times to repeat the benchmark\n");
+    LOG("\t--distribution       How to pick elements in the hot range (cyclic, uniform, zipf, rmat, or replay)\n");
+    LOG("\t--alpha              Exponent of the zipf distribution (default 1.0)\n");
+    LOG("\t--rmat               RMAT parameters a,b,c (default 0.57,0.19,0.19)\n");
+    LOG("\t--replay_file        File of 64-bit indices to replay, for the replay distribution\n");
+    LOG("\t--seed               Seed for the random distributions\n");
+    LOG("\t--heatmap            Write operations per nodelet and the hottest elements to this file (.csv or .json)\n");
+    LOG("\t--top_k              Number of hottest elements to write to the heatmap (default 16)\n");
+    LOG("\t--layout             How to allocate the array: striped, chunked, local, or replicated\n");
     LOG("\t--help               Print command line help\n");
 }
 
@@ -259,6 +757,14 @@ typedef struct hot_range_args {
     long log2_offset;
     long log2_length;
     long num_trials;
+    const char* distribution;
+    double alpha;
+    const char* rmat;
+    const char* replay_file;
+    long seed;
+    const char* heatmap;
+    long top_k;
+    const char* layout;
 } hot_range_args;
 
 static struct hot_range_args
@@ -267,10 +773,18 @@ parse_args(int argc, char *argv[])
     hot_range_args args;
     args.log2_num_elements = -1;
     args.num_threads = -1;
-    args.op_mode = "OP_REMOTE_ADD";
+    args.op_mode = "REMOTE_ADD";
     args.log2_offset = 0;
     args.log2_length = -1;
     args.num_trials = 1;
+    args.distribution = "cyclic";
+    args.alpha = 1.0;
+    args.rmat = NULL;
+    args.replay_file = NULL;
+    args.seed = 0;
+    args.heatmap = NULL;
+    args.top_k = 16;
+    args.layout = "striped";
 
     int option_index;
     while (true)
@@ -298,6 +812,22 @@ parse_args(int argc, char *argv[])
             args.log2_length = atol(optarg);
         } else if (!strcmp(option_name, "num_trials")) {
             args.num_trials = atol(optarg);
+        } else if (!strcmp(option_name, "distribution")) {
+            args.distribution = optarg;
+        } else if (!strcmp(option_name, "alpha")) {
+            args.alpha = atof(optarg);
+        } else if (!strcmp(option_name, "rmat")) {
+            args.rmat = optarg;
+        } else if (!strcmp(option_name, "replay_file")) {
+            args.replay_file = optarg;
+        } else if (!strcmp(option_name, "seed")) {
+            args.seed = atol(optarg);
+        } else if (!strcmp(option_name, "heatmap")) {
+            args.heatmap = optarg;
+        } else if (!strcmp(option_name, "top_k")) {
+            args.top_k = atol(optarg);
+        } else if (!strcmp(option_name, "layout")) {
+            args.layout = optarg;
         } else if (!strcmp(option_name, "help")) {
             print_help(argv[0]);
             exit(1);
@@ -309,6 +839,8 @@ parse_args(int argc, char *argv[])
     if (args.log2_length <  0) { LOG( "log2_length must be >= 0"); exit(1); }
     if (args.log2_offset >= args.log2_num_elements) { LOG( "log2_offset must be < log2_num_elements"); exit(1); }
     if (args.log2_length >  args.log2_num_elements) { LOG( "log2_length must be <= log2_num_elements"); exit(1); }
+    if (args.alpha <= 0) { LOG( "alpha must be > 0"); exit(1); }
+    if (args.top_k <= 0) { LOG( "top_k must be > 0"); exit(1); }
     return args;
 }
 
@@ -330,36 +862,89 @@ int main(int argc, char** argv)
         op_mode = OP_ATOMIC_CAS;
     } else if (!strcmp(args.op_mode, "REMOTE_WRITE")) {
         op_mode = OP_REMOTE_WRITE;
+    } else if (!strcmp(args.op_mode, "COMBINED_ADD")) {
+        op_mode = OP_COMBINED_ADD;
+    } else if (!strcmp(args.op_mode, "FETCH_ADD")) {
+        op_mode = OP_FETCH_ADD;
+    } else if (!strcmp(args.op_mode, "ATOMIC_MIN")) {
+        op_mode = OP_ATOMIC_MIN;
+    } else if (!strcmp(args.op_mode, "ATOMIC_MAX")) {
+        op_mode = OP_ATOMIC_MAX;
+    } else if (!strcmp(args.op_mode, "REMOTE_MIN")) {
+        op_mode = OP_REMOTE_MIN;
+    } else if (!strcmp(args.op_mode, "REMOTE_MAX")) {
+        op_mode = OP_REMOTE_MAX;
+    } else if (!strcmp(args.op_mode, "ATOMIC_OR")) {
+        op_mode = OP_ATOMIC_OR;
     } else {
         LOG( "Operation %s not implemented!\n", args.op_mode);
         exit(1);
     }
 
+    long layout;
+    if (!strcmp(args.layout, "striped")) {
+        layout = LAYOUT_STRIPED;
+    } else if (!strcmp(args.layout, "chunked")) {
+        layout = LAYOUT_CHUNKED;
+    } else if (!strcmp(args.layout, "local")) {
+        layout = LAYOUT_LOCAL;
+    } else if (!strcmp(args.layout, "replicated")) {
+        layout = LAYOUT_REPLICATED;
+    } else {
+        LOG( "Layout %s not implemented!\n", args.layout);
+        exit(1);
+    }
+
     hooks_set_attr_i64("num_threads", args.num_threads);
     hooks_set_attr_i64("log2_num_elements", args.log2_num_elements);
     hooks_set_attr_i64("log2_offset", args.log2_offset);
     hooks_set_attr_i64("log2_length", args.log2_length);
     hooks_set_attr_str("op_mode", args.op_mode);
+    hooks_set_attr_str("distribution", args.distribution);
+    hooks_set_attr_str("layout", args.layout);
     hooks_set_attr_i64("num_nodelets", NODELETS());
 
     long n = 1L << args.log2_num_elements;
     long offset = 1L << args.log2_offset;
     long length = 1L << args.log2_length;
+
+    long distribution;
+    if (!index_distribution_parse(args.distribution, &distribution)) {
+        LOG( "Distribution %s not implemented!\n", args.distribution);
+        exit(1);
+    }
+    index_generator generator;
+    index_generator_init(&generator, distribution, length, args.seed);
+    if (distribution == INDEX_DIST_ZIPF) {
+        index_generator_set_zipf(&generator, args.alpha);
+        hooks_set_attr_f64("alpha", args.alpha);
+    } else if (distribution == INDEX_DIST_RMAT && args.rmat != NULL) {
+        index_generator_set_rmat(&generator, args.rmat);
+    } else if (distribution == INDEX_DIST_REPLAY) {
+        if (args.replay_file == NULL) { LOG( "replay distribution requires --replay_file\n"); exit(1); }
+        index_generator_load_replay(&generator, args.replay_file);
+    }
     LOG("Initializing array...\n")
 
     hooks_region_begin("init");
-    hot_range_data_init(&data, n, op_mode, offset, length, args.num_threads);
+    hot_range_data_init(&data, n, op_mode, layout, offset, length, args.num_threads, &generator);
     hooks_region_end();
 
-    LOG("Spawning %li threads to do a total of 2^%li %s operations on an array of 2^%li elements with an offset of 2^%li...\n",
+    LOG("Spawning %li threads to do a total of 2^%li %s operations on a %s array of 2^%li elements with an offset of 2^%li...\n",
         args.num_threads,
         args.log2_num_elements,
         args.op_mode,
+        args.layout,
         args.log2_length,
         args.log2_offset);
 
-    hot_range_run(&data,args.num_trials);
+    benchmark_stats stats = hot_range_run(&data,args.num_trials);
+    if (args.heatmap != NULL) {
+        double mops = stats.median == 0 ? 0 : (n / 1e6) / (stats.median / 1000);
+        hot_range_write_heatmap(&data, args.heatmap, args.top_k, args.op_mode, stats.median, mops);
+    }
 
     hot_range_data_deinit(&data);
+    index_generator_deinit(&generator);
     return 0;
 }
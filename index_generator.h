@@ -0,0 +1,459 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <emu_c_utils/emu_c_utils.h>
+
+#include "common.h"
+
+/*
+ * Generates skewed streams of array indices, shared by hot_range and pointer_chase
+ *
+ * Distributions over [0, length):
+ *     cyclic    0, 1, 2, ..., length-1, 0, 1, ... (no randomness)
+ *     uniform   Every index is equally likely
+ *     zipf      Index k has probability proportional to 1 / (k+1)^alpha
+ *     rmat      Endpoints of RMAT edges: even samples are sources (each bit is 1 with probability c + d),
+ *               odd samples are destinations (each bit is 1 with probability b + d)
+ *     replay    Indices read from a file of 64-bit integers, repeated as needed
+ *
+ * Sample i only depends on the seed and i (counter-based random numbers), so any thread
+ * can generate any part of the stream in parallel, and results are reproducible.
+ */
+enum index_distribution {
+    INDEX_DIST_CYCLIC,
+    INDEX_DIST_UNIFORM,
+    INDEX_DIST_ZIPF,
+    INDEX_DIST_RMAT,
+    INDEX_DIST_REPLAY,
+};
+
+typedef struct index_generator {
+    // One of the index_distribution values
+    long distribution;
+    // Samples are in [0, length)
+    long length;
+    long seed;
+    // zipf: exponent
+    double alpha;
+    // rmat: quadrant probabilities, d = 1 - a - b - c
+    double rmat_a, rmat_b, rmat_c;
+    // zipf: constants for rejection-inversion sampling
+    double zipf_h_x1, zipf_h_n, zipf_s;
+    // replay: indices read from the file
+    long * replay;
+    long replay_count;
+} index_generator;
+
+static inline bool
+index_distribution_parse(const char * name, long * distribution)
+{
+    if      (!strcmp(name, "cyclic"))  { *distribution = INDEX_DIST_CYCLIC; }
+    else if (!strcmp(name, "uniform")) { *distribution = INDEX_DIST_UNIFORM; }
+    else if (!strcmp(name, "zipf"))    { *distribution = INDEX_DIST_ZIPF; }
+    else if (!strcmp(name, "rmat"))    { *distribution = INDEX_DIST_RMAT; }
+    else if (!strcmp(name, "replay"))  { *distribution = INDEX_DIST_REPLAY; }
+    else { return false; }
+    return true;
+}
+
+// splitmix64: a good 64-bit hash, used as a counter-based random number generator
+static inline unsigned long
+index_generator_mix(unsigned long x)
+{
+    x += 0x9E3779B97F4A7C15UL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+    return x ^ (x >> 31);
+}
+
+// Uniform random number in (0, 1), the j'th one drawn for sample i
+static inline double
+index_generator_uniform(const index_generator * gen, long i, long j)
+{
+    unsigned long x = index_generator_mix(index_generator_mix((unsigned long)gen->seed ^ (unsigned long)i) + (unsigned long)j);
+    return ((x >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * Zipf sampling by rejection-inversion, from Hormann and Derflinger,
+ * "Rejection-inversion to generate variates from monotone discrete distributions" (1996)
+ */
+static inline double
+zipf_helper1(double x) { return fabs(x) > 1e-8 ? log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x)); }
+static inline double
+zipf_helper2(double x) { return fabs(x) > 1e-8 ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x)); }
+static inline double
+zipf_h(double alpha, double x) { return exp(-alpha * log(x)); }
+static inline double
+zipf_h_integral(double alpha, double x) { double log_x = log(x); return zipf_helper2((1 - alpha) * log_x) * log_x; }
+static inline double
+zipf_h_integral_inverse(double alpha, double x)
+{
+    double t = x * (1 - alpha);
+    if (t < -1) { t = -1; }
+    return exp(zipf_helper1(t) * x);
+}
+
+static inline long
+index_generator_zipf(const index_generator * gen, long i)
+{
+    const double alpha = gen->alpha;
+    for (long j = 0; ; ++j) {
+        double u = gen->zipf_h_n + index_generator_uniform(gen, i, j) * (gen->zipf_h_x1 - gen->zipf_h_n);
+        double x = zipf_h_integral_inverse(alpha, u);
+        long k = (long)(x + 0.5);
+        if (k < 1) { k = 1; } else if (k > gen->length) { k = gen->length; }
+        if (k - x <= gen->zipf_s || u >= zipf_h_integral(alpha, k + 0.5) - zipf_h(alpha, k)) {
+            return k - 1;
+        }
+    }
+}
+
+// Probability that a bit of an RMAT source (c + d) or destination (b + d) endpoint is 1
+static inline double
+index_generator_rmat_p_one(const index_generator * gen, bool destination)
+{
+    return 1.0 - gen->rmat_a - (destination ? gen->rmat_c : gen->rmat_b);
+}
+
+static inline long
+index_generator_rmat(const index_generator * gen, long i)
+{
+    const double p_one = index_generator_rmat_p_one(gen, i & 1);
+    long index = 0;
+    for (long bit = 0; (1L << bit) < gen->length; ++bit) {
+        if (index_generator_uniform(gen, i, bit) < p_one) { index |= 1L << bit; }
+    }
+    return index % gen->length;
+}
+
+// Returns the i'th index of the stream, in [0, length)
+static inline long
+index_generator_sample(const index_generator * gen, long i)
+{
+    switch (gen->distribution) {
+        case INDEX_DIST_UNIFORM: return (long)(index_generator_uniform(gen, i, 0) * gen->length);
+        case INDEX_DIST_ZIPF:    return index_generator_zipf(gen, i);
+        case INDEX_DIST_RMAT:    return index_generator_rmat(gen, i);
+        case INDEX_DIST_REPLAY:  return gen->replay[i % gen->replay_count] % gen->length;
+        default:                 return i % gen->length;
+    }
+}
+
+// Relative probability of drawing this index
+static inline double
+index_generator_weight(const index_generator * gen, long index)
+{
+    switch (gen->distribution) {
+        case INDEX_DIST_ZIPF: return zipf_h(gen->alpha, index + 1);
+        case INDEX_DIST_RMAT: {
+            // Half the samples are sources, half are destinations
+            const double p_src = index_generator_rmat_p_one(gen, false);
+            const double p_dst = index_generator_rmat_p_one(gen, true);
+            double w_src = 1, w_dst = 1;
+            for (long bit = 0; (1L << bit) < gen->length; ++bit) {
+                w_src *= (index >> bit) & 1 ? p_src : 1 - p_src;
+                w_dst *= (index >> bit) & 1 ? p_dst : 1 - p_dst;
+            }
+            return 0.5 * (w_src + w_dst);
+        }
+        default: return 1;
+    }
+}
+
+static inline void
+index_generator_init(index_generator * gen, long distribution, long length, long seed)
+{
+    memset(gen, 0, sizeof(*gen));
+    gen->distribution = distribution;
+    gen->length = length;
+    gen->seed = seed;
+    gen->alpha = 1.0;
+    gen->rmat_a = 0.57; gen->rmat_b = 0.19; gen->rmat_c = 0.19;
+}
+
+// Call after changing alpha
+static inline void
+index_generator_set_zipf(index_generator * gen, double alpha)
+{
+    runtime_assert(alpha > 0, "Zipf exponent must be > 0");
+    gen->alpha = alpha;
+    gen->zipf_h_x1 = zipf_h_integral(alpha, 1.5) - 1;
+    gen->zipf_h_n = zipf_h_integral(alpha, gen->length + 0.5);
+    gen->zipf_s = 2 - zipf_h_integral_inverse(alpha, zipf_h_integral(alpha, 2.5) - zipf_h(alpha, 2));
+}
+
+// Parses "a,b,c"
+static inline void
+index_generator_set_rmat(index_generator * gen, const char * params)
+{
+    runtime_assert(sscanf(params, "%lf,%lf,%lf", &gen->rmat_a, &gen->rmat_b, &gen->rmat_c) == 3,
+        "RMAT parameters must be formatted as a,b,c");
+    runtime_assert(gen->rmat_a >= 0 && gen->rmat_b >= 0 && gen->rmat_c >= 0
+        && gen->rmat_a + gen->rmat_b + gen->rmat_c <= 1, "Invalid RMAT parameters");
+}
+
+// Reads a file of native-endian 64-bit integers
+static inline void
+index_generator_load_replay(index_generator * gen, const char * filename)
+{
+    FILE * fp = fopen(filename, "rb");
+    runtime_assert(fp != NULL, "Failed to open replay file");
+    fseek(fp, 0, SEEK_END);
+    long count = ftell(fp) / (long)sizeof(long);
+    fseek(fp, 0, SEEK_SET);
+    runtime_assert(count > 0, "Replay file is empty");
+    gen->replay = (long*)malloc(count * sizeof(long));
+    runtime_assert(gen->replay != NULL, "Failed to allocate replay buffer");
+    runtime_assert(fread(gen->replay, sizeof(long), count, fp) == (size_t)count, "Failed to read replay file");
+    fclose(fp);
+    for (long i = 0; i < count; ++i) {
+        runtime_assert(gen->replay[i] >= 0, "Replay file contains a negative index");
+    }
+    gen->replay_count = count;
+}
+
+static inline void
+index_generator_deinit(index_generator * gen)
+{
+    free(gen->replay);
+    gen->replay = NULL;
+}
+
+static inline unsigned long
+index_generator_mix_double(unsigned long h, double x)
+{
+    unsigned long bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return index_generator_mix(h ^ bits);
+}
+
+// Hash of the distribution and its parameters (including the contents of the replay file), 0 for cyclic
+static inline long
+index_generator_fingerprint(const index_generator * gen)
+{
+    if (gen->distribution == INDEX_DIST_CYCLIC) { return 0; }
+    unsigned long h = index_generator_mix(gen->distribution);
+    if (gen->distribution == INDEX_DIST_ZIPF) {
+        h = index_generator_mix_double(h, gen->alpha);
+    } else if (gen->distribution == INDEX_DIST_RMAT) {
+        h = index_generator_mix_double(h, gen->rmat_a);
+        h = index_generator_mix_double(h, gen->rmat_b);
+        h = index_generator_mix_double(h, gen->rmat_c);
+    } else if (gen->distribution == INDEX_DIST_REPLAY) {
+        for (long i = 0; i < gen->replay_count; ++i) {
+            h = index_generator_mix(h ^ (unsigned long)gen->replay[i]);
+        }
+    }
+    return (long)h;
+}
+
+typedef struct index_generator_key {
+    double key;
+    long index;
+} index_generator_key;
+
+static inline int
+index_generator_compare_keys(const void * a, const void * b)
+{
+    const index_generator_key * x = (const index_generator_key*)a;
+    const index_generator_key * y = (const index_generator_key*)b;
+    if (x->key != y->key) { return x->key < y->key ? -1 : 1; }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+/*
+ * Parallel sort of the permutation keys (sample sort, with the same bucket scheme as parallel_shuffle in pointer_chase):
+ * 1. Each chunk of keys is generated in parallel
+ * 2. Splitters drawn from an evenly spaced sample divide the keys into buckets of about the same size
+ * 3. A prefix sum over the (chunk, bucket) counts gives each chunk a place to write in each bucket
+ * 4. Each chunk scatters its keys to the buckets, and each bucket is sorted independently
+ * Keys are ordered by (key, index), so the result is the same as one big sort.
+ */
+#define INDEX_GENERATOR_SORT_LOG2_BUCKETS 8
+#define INDEX_GENERATOR_SORT_BUCKETS (1L << INDEX_GENERATOR_SORT_LOG2_BUCKETS)
+// Keys sampled per bucket to choose the splitters
+#define INDEX_GENERATOR_SORT_OVERSAMPLE 16
+// Smaller permutations are sorted serially
+#define INDEX_GENERATOR_SORT_MIN_SIZE (1L << 16)
+
+// First element of a chunk (or bucket) when n elements are split into INDEX_GENERATOR_SORT_BUCKETS pieces
+static inline long
+index_generator_sort_chunk_begin(long n, long chunk)
+{
+    return n / INDEX_GENERATOR_SORT_BUCKETS * chunk + (chunk < n % INDEX_GENERATOR_SORT_BUCKETS ? chunk : n % INDEX_GENERATOR_SORT_BUCKETS);
+}
+
+// Bucket of a key: the number of splitters that are smaller
+static inline long
+index_generator_sort_bucket(const index_generator_key * splitters, const index_generator_key * key)
+{
+    long low = 0, high = INDEX_GENERATOR_SORT_BUCKETS - 1;
+    while (low < high) {
+        long mid = (low + high) / 2;
+        if (index_generator_compare_keys(&splitters[mid], key) < 0) { low = mid + 1; } else { high = mid; }
+    }
+    return low;
+}
+
+static noinline void
+index_generator_keys_worker(long begin, long end, va_list args)
+{
+    const index_generator * gen = va_arg(args, const index_generator *);
+    index_generator_key * keys = va_arg(args, index_generator_key *);
+    for (long i = begin; i < end; ++i) {
+        keys[i].key = -log(index_generator_uniform(gen, i, 0)) / index_generator_weight(gen, i);
+        keys[i].index = i;
+    }
+}
+
+static noinline void
+index_generator_sort_count_worker(long begin, long end, va_list args)
+{
+    long n = va_arg(args, long);
+    const index_generator_key * keys = va_arg(args, const index_generator_key *);
+    const index_generator_key * splitters = va_arg(args, const index_generator_key *);
+    long * counts = va_arg(args, long *);
+    for (long chunk = begin; chunk < end; ++chunk) {
+        long * chunk_counts = counts + chunk * INDEX_GENERATOR_SORT_BUCKETS;
+        long last = index_generator_sort_chunk_begin(n, chunk + 1);
+        for (long i = index_generator_sort_chunk_begin(n, chunk); i < last; ++i) {
+            chunk_counts[index_generator_sort_bucket(splitters, &keys[i])] += 1;
+        }
+    }
+}
+
+static noinline void
+index_generator_sort_scatter_worker(long begin, long end, va_list args)
+{
+    long n = va_arg(args, long);
+    const index_generator_key * keys = va_arg(args, const index_generator_key *);
+    const index_generator_key * splitters = va_arg(args, const index_generator_key *);
+    long * offsets = va_arg(args, long *);
+    index_generator_key * dst = va_arg(args, index_generator_key *);
+    for (long chunk = begin; chunk < end; ++chunk) {
+        long * chunk_offsets = offsets + chunk * INDEX_GENERATOR_SORT_BUCKETS;
+        long last = index_generator_sort_chunk_begin(n, chunk + 1);
+        for (long i = index_generator_sort_chunk_begin(n, chunk); i < last; ++i) {
+            dst[chunk_offsets[index_generator_sort_bucket(splitters, &keys[i])]++] = keys[i];
+        }
+    }
+}
+
+// Sorts each bucket and writes its part of the permutation
+static noinline void
+index_generator_sort_bucket_worker(long begin, long end, va_list args)
+{
+    const long * bucket_offsets = va_arg(args, const long *);
+    index_generator_key * keys = va_arg(args, index_generator_key *);
+    long * perm = va_arg(args, long *);
+    for (long bucket = begin; bucket < end; ++bucket) {
+        long first = bucket_offsets[bucket], last = bucket_offsets[bucket + 1];
+        qsort(keys + first, last - first, sizeof(index_generator_key), index_generator_compare_keys);
+        for (long i = first; i < last; ++i) { perm[i] = keys[i].index; }
+    }
+}
+
+// Weighted random permutation, see index_generator_permutation
+static inline void
+index_generator_weighted_permutation(const index_generator * gen, long * perm)
+{
+    const long n = gen->length;
+    index_generator_key * keys = (index_generator_key*)mw_localmalloc(n * sizeof(index_generator_key), perm);
+    runtime_assert(keys != NULL, "Failed to allocate keys for permutation");
+    emu_local_for(0, n, LOCAL_GRAIN(n),
+        index_generator_keys_worker, gen, keys
+    );
+    if (n < INDEX_GENERATOR_SORT_MIN_SIZE) {
+        qsort(keys, n, sizeof(index_generator_key), index_generator_compare_keys);
+        for (long i = 0; i < n; ++i) { perm[i] = keys[i].index; }
+        mw_localfree(keys);
+        return;
+    }
+    const long num_chunks = INDEX_GENERATOR_SORT_BUCKETS;
+    const long num_buckets = INDEX_GENERATOR_SORT_BUCKETS;
+
+    // Splitters: every INDEX_GENERATOR_SORT_OVERSAMPLE'th key of a sorted, evenly spaced sample
+    const long num_samples = num_buckets * INDEX_GENERATOR_SORT_OVERSAMPLE;
+    index_generator_key * samples = (index_generator_key*)mw_localmalloc(num_samples * sizeof(index_generator_key), perm);
+    runtime_assert(samples != NULL, "Failed to allocate samples for permutation");
+    for (long s = 0; s < num_samples; ++s) { samples[s] = keys[s * (n / num_samples)]; }
+    qsort(samples, num_samples, sizeof(index_generator_key), index_generator_compare_keys);
+    index_generator_key * splitters = (index_generator_key*)mw_localmalloc(num_buckets * sizeof(index_generator_key), perm);
+    runtime_assert(splitters != NULL, "Failed to allocate splitters for permutation");
+    for (long b = 0; b < num_buckets - 1; ++b) {
+        splitters[b] = samples[(b + 1) * INDEX_GENERATOR_SORT_OVERSAMPLE];
+    }
+    mw_localfree(samples);
+
+    // counts[chunk][bucket] = number of keys from this chunk that go to this bucket
+    long * counts = (long*)mw_localmalloc(sizeof(long) * num_chunks * num_buckets, perm);
+    runtime_assert(counts != NULL, "Failed to allocate bucket counts for permutation");
+    memset(counts, 0, sizeof(long) * num_chunks * num_buckets);
+    emu_local_for(0, num_chunks, 1,
+        index_generator_sort_count_worker, n, keys, splitters, counts
+    );
+
+    // Exclusive prefix sum in bucket-major order, so each bucket is contiguous
+    long * bucket_offsets = (long*)mw_localmalloc(sizeof(long) * (num_buckets + 1), perm);
+    runtime_assert(bucket_offsets != NULL, "Failed to allocate bucket offsets for permutation");
+    long total = 0;
+    for (long bucket = 0; bucket < num_buckets; ++bucket) {
+        bucket_offsets[bucket] = total;
+        for (long chunk = 0; chunk < num_chunks; ++chunk) {
+            long count = counts[chunk * num_buckets + bucket];
+            counts[chunk * num_buckets + bucket] = total;
+            total += count;
+        }
+    }
+    bucket_offsets[num_buckets] = total;
+
+    index_generator_key * sorted = (index_generator_key*)mw_localmalloc(n * sizeof(index_generator_key), perm);
+    runtime_assert(sorted != NULL, "Failed to allocate temporary keys for permutation");
+    emu_local_for(0, num_chunks, 1,
+        index_generator_sort_scatter_worker, n, keys, splitters, counts, sorted
+    );
+    mw_localfree(keys);
+    emu_local_for(0, num_buckets, 1,
+        index_generator_sort_bucket_worker, bucket_offsets, sorted, perm
+    );
+
+    mw_localfree(sorted);
+    mw_localfree(bucket_offsets);
+    mw_localfree(counts);
+    mw_localfree(splitters);
+}
+
+/*
+ * Fills perm with a permutation of [0, length) in which likely indices tend to come first.
+ * For random distributions, this is a weighted random permutation (Efraimidis and Spirakis):
+ * sort by -log(u) / weight, in parallel (see index_generator_weighted_permutation).
+ * For replay, indices are taken in order of first appearance in the file,
+ * followed by the indices that never appear.
+ */
+static inline void
+index_generator_permutation(const index_generator * gen, long * perm)
+{
+    const long n = gen->length;
+    if (gen->distribution == INDEX_DIST_CYCLIC) {
+        for (long i = 0; i < n; ++i) { perm[i] = i; }
+    } else if (gen->distribution == INDEX_DIST_REPLAY) {
+        bool * seen = (bool*)calloc(n, sizeof(bool));
+        runtime_assert(seen != NULL, "Failed to allocate bitmap for permutation");
+        long pos = 0;
+        for (long i = 0; i < gen->replay_count && pos < n; ++i) {
+            long index = gen->replay[i] % n;
+            if (!seen[index]) { seen[index] = true; perm[pos++] = index; }
+        }
+        for (long index = 0; index < n; ++index) {
+            if (!seen[index]) { perm[pos++] = index; }
+        }
+        free(seen);
+    } else {
+        index_generator_weighted_permutation(gen, perm);
+    }
+}
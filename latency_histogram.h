@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <emu_c_utils/emu_c_utils.h>
+
+#include "common.h"
+
+#if defined(__x86_64__) && !defined(__le64__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Log-scale histogram of latencies measured in clock cycles
+ *
+ * Bucket b counts samples in the range [2^b, 2^(b+1)) cycles (bucket 0 also counts zero).
+ * Each sample is added with REMOTE_ADD into the copy of a replicated histogram on the nodelet where the
+ * thread is running, and the copies are summed across nodelets once the benchmark is done.
+ */
+#define LATENCY_HISTOGRAM_BUCKETS 64
+
+// Cycle counter: CLOCK() on Emu, the time stamp counter on x86
+static inline unsigned long
+latency_clock(void)
+{
+#if defined(__x86_64__) && !defined(__le64__)
+    return __rdtsc();
+#else
+    return CLOCK();
+#endif
+}
+
+static inline long
+latency_histogram_bucket(unsigned long cycles)
+{
+    return cycles == 0 ? 0 : PRIORITY(cycles);
+}
+
+// Counts one sample in the local nodelet's copy of a replicated histogram
+// (a private histogram on the stack would pull a migrating thread back to its home nodelet on every update)
+static inline void
+latency_histogram_record(long * buckets, unsigned long cycles)
+{
+    long * local = mw_get_nth(buckets, NODE_ID());
+    REMOTE_ADD(&local[latency_histogram_bucket(cycles)], 1);
+}
+
+// Zeroes every nodelet's copy of a histogram stored in a replicated struct
+static inline void
+latency_histogram_clear_replicated(long * buckets)
+{
+    for (long b = 0; b < LATENCY_HISTOGRAM_BUCKETS; ++b) {
+        mw_replicated_init(&buckets[b], 0);
+    }
+}
+
+// Sums every nodelet's copy of a histogram stored in a replicated struct
+static inline void
+latency_histogram_reduce_replicated(long * buckets, long * total)
+{
+    for (long b = 0; b < LATENCY_HISTOGRAM_BUCKETS; ++b) {
+        total[b] = 0;
+        for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+            total[b] += ((long*)mw_get_nth(&buckets[b], nlet))[0];
+        }
+    }
+}
+
+// Smallest bucket that holds at least this fraction of the samples
+static inline long
+latency_histogram_percentile(const long * buckets, double p)
+{
+    long count = 0;
+    for (long b = 0; b < LATENCY_HISTOGRAM_BUCKETS; ++b) { count += buckets[b]; }
+    long seen = 0;
+    for (long b = 0; b < LATENCY_HISTOGRAM_BUCKETS; ++b) {
+        seen += buckets[b];
+        if (count > 0 && seen >= p * count) { return b; }
+    }
+    return LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+static inline void
+latency_histogram_print(const long * buckets)
+{
+    long count = 0;
+    for (long b = 0; b < LATENCY_HISTOGRAM_BUCKETS; ++b) { count += buckets[b]; }
+    LOG("Latency histogram (%li samples):\n", count);
+    if (count == 0) { return; }
+    for (long b = 0; b < LATENCY_HISTOGRAM_BUCKETS; ++b) {
+        if (buckets[b] == 0) { continue; }
+        LOG("    [%12lu, %12lu) cycles: %12li (%5.2f%%)\n",
+            b == 0 ? 0UL : 1UL << b, 2UL << b, buckets[b], 100.0 * buckets[b] / count);
+    }
+    LOG("    p50 < %lu cycles, p99 < %lu cycles\n",
+        2UL << latency_histogram_percentile(buckets, 0.50),
+        2UL << latency_histogram_percentile(buckets, 0.99));
+}
@@ -9,6 +9,7 @@
 
 #include "recursive_spawn.h"
 #include "common.h"
+#include "benchmark_driver.h"
 
 typedef struct local_sort_data {
     long * array;
@@ -66,14 +67,14 @@ void local_sort_run(
     void (*benchmark)(local_sort_data *),
     long num_trials)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin(name);
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, name, num_trials, data->n * sizeof(long), "MB/s");
+    while (benchmark_driver_next(&driver)) {
+        benchmark_driver_begin_trial(&driver);
         benchmark(data);
-        double time_ms = hooks_region_end();
-        double bytes_per_second = (data->n * sizeof(long)) / (time_ms/1000);
-        LOG("%3.2f MB/s\n", bytes_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
     }
+    benchmark_driver_finish(&driver);
 }
 
 int main(int argc, char** argv)
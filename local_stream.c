@@ -5,10 +5,15 @@
 #include <cilk/cilk.h>
 #include <assert.h>
 #include <string.h>
+#include <getopt.h>
 #include <emu_c_utils/emu_c_utils.h>
 
 #include "recursive_spawn.h"
 #include "common.h"
+#include "benchmark_driver.h"
+#include "thread_sweep.h"
+#include "stream_kernel.h"
+#include "stream_simd.h"
 
 typedef struct local_stream_data {
     long * a;
@@ -16,10 +21,13 @@ typedef struct local_stream_data {
     long * c;
     long n;
     long num_threads;
+    // One of the stream_kernel values
+    long kernel;
 } local_stream_data;
 
+// Allocates the arrays without touching them
 void
-local_stream_init(local_stream_data * data, long n)
+local_stream_alloc(local_stream_data * data, long n)
 {
     data->n = n;
     data->a = mw_localmalloc(n * sizeof(long), data);
@@ -28,10 +36,36 @@ local_stream_init(local_stream_data * data, long n)
     assert(data->b);
     data->c = mw_localmalloc(n * sizeof(long), data);
     assert(data->c);
+}
+
+static void
+local_stream_first_touch_worker(long begin, long end, va_list args)
+{
+    long *a = va_arg(args, long*);
+    long *b = va_arg(args, long*);
+    long *c = va_arg(args, long*);
+    for (long i = begin; i < end; ++i) {
+        a[i] = 1;
+        b[i] = 2;
+        c[i] = 0;
+    }
+}
+
+// Writes initial values to each array, using num_threads threads
+void
+local_stream_first_touch(local_stream_data * data)
+{
+    emu_local_for(0, data->n, data->n / data->num_threads,
+        local_stream_first_touch_worker, data->a, data->b, data->c
+    );
+}
+
+void
+local_stream_init(local_stream_data * data, long n)
+{
+    local_stream_alloc(data, n);
 #ifndef NO_VALIDATE
-    emu_local_for_set_long(data->a, n, 1);
-    emu_local_for_set_long(data->b, n, 2);
-    emu_local_for_set_long(data->c, n, 0);
+    local_stream_first_touch(data);
 #endif
 }
 
@@ -47,7 +81,7 @@ void
 local_stream_add_serial(local_stream_data * data)
 {
     for (long i = 0; i < data->n; ++i) {
-        data->c[i] = data->a[i] + data->b[i];
+        STREAM_KERNEL_APPLY(data->kernel, data->c[i], data->a[i], data->b[i]);
     }
 }
 
@@ -58,7 +92,7 @@ local_stream_add_cilk_for(local_stream_data * data)
     #pragma cilk grainsize = data->n / data->num_threads
 #endif
     cilk_for (long i = 0; i < data->n; ++i) {
-        data->c[i] = data->a[i] + data->b[i];
+        STREAM_KERNEL_APPLY(data->kernel, data->c[i], data->a[i], data->b[i]);
     }
 }
 
@@ -66,7 +100,7 @@ static void
 recursive_spawn_add_worker(long begin, long end, local_stream_data *data)
 {
     for (long i = begin; i < end; ++i) {
-        data->c[i] = data->a[i] + data->b[i];
+        STREAM_KERNEL_APPLY(data->kernel, data->c[i], data->a[i], data->b[i]);
     }
 }
 
@@ -100,42 +134,108 @@ local_stream_add_library_worker(long begin, long end, va_list args)
     long *a = va_arg(args, long*);
     long *b = va_arg(args, long*);
     long *c = va_arg(args, long*);
+    long kernel = va_arg(args, long);
     for (long i = begin; i < end; ++i) {
-        c[i] = a[i] + b[i];
+        STREAM_KERNEL_APPLY(kernel, c[i], a[i], b[i]);
     }
 }
 
 void local_stream_add_library(local_stream_data * data)
 {
     emu_local_for(0, data->n, data->n / data->num_threads,
-        local_stream_add_library_worker, data->a, data->b, data->c
+        local_stream_add_library_worker, data->a, data->b, data->c, data->kernel
     );
 }
 
-void local_stream_run(
+#ifdef HAVE_STREAM_SIMD
+static noinline void
+simd_add_worker(long begin, long end, local_stream_data *data)
+{
+    stream_simd_kernel(data->kernel, data->c, data->a, data->b, begin, end);
+}
+
+static noinline void
+simd_nt_add_worker(long begin, long end, local_stream_data *data)
+{
+    stream_simd_kernel_nt(data->kernel, data->c, data->a, data->b, begin, end);
+}
+
+// simd - serial_spawn with an explicitly vectorized worker
+void
+local_stream_add_simd(local_stream_data * data)
+{
+    long grain = data->n / data->num_threads;
+    for (long i = 0; i < data->n; i += grain) {
+        long begin = i;
+        long end = begin + grain <= data->n ? begin + grain : data->n;
+        cilk_spawn simd_add_worker(begin, end, data);
+    }
+    cilk_sync;
+}
+
+// simd_nt - same as simd, but with non-temporal (streaming) stores
+void
+local_stream_add_simd_nt(local_stream_data * data)
+{
+    long grain = data->n / data->num_threads;
+    for (long i = 0; i < data->n; i += grain) {
+        long begin = i;
+        long end = begin + grain <= data->n ? begin + grain : data->n;
+        cilk_spawn simd_nt_add_worker(begin, end, data);
+    }
+    cilk_sync;
+}
+#endif
+
+double local_stream_run(
     local_stream_data * data,
     const char * name,
     void (*benchmark)(local_stream_data *),
-    long num_trials)
+    long num_trials,
+    long num_warmup)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin(name);
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, name, num_trials,
+        data->n * stream_kernel_bytes_per_element(data->kernel), "MB/s");
+    driver.num_warmup = num_warmup;
+    while (benchmark_driver_next(&driver)) {
+        benchmark_driver_begin_trial(&driver);
         benchmark(data);
-        double time_ms = hooks_region_end();
-        double bytes_per_second = time_ms == 0 ? 0 :
-            (data->n * sizeof(long) * 3) / (time_ms/1000);
-        LOG("%3.2f MB/s\n", bytes_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
     }
+    benchmark_stats stats = benchmark_driver_finish(&driver);
+    return benchmark_driver_throughput(&driver, stats.median);
+}
+
+// first_touch - time only the initial write to freshly allocated arrays
+double local_stream_first_touch_run(
+    local_stream_data * data,
+    long num_trials,
+    long num_warmup)
+{
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "first_touch", num_trials, data->n * sizeof(long) * 3, "MB/s");
+    driver.num_warmup = num_warmup;
+    while (benchmark_driver_next(&driver)) {
+        // Replace the arrays with allocations that have never been touched
+        local_stream_deinit(data);
+        local_stream_alloc(data, data->n);
+        benchmark_driver_begin_trial(&driver);
+        local_stream_first_touch(data);
+        benchmark_driver_end_trial(&driver);
+    }
+    benchmark_stats stats = benchmark_driver_finish(&driver);
+    return benchmark_driver_throughput(&driver, stats.median);
 }
 
 static void
 local_stream_validate_worker(long begin, long end, va_list args)
 {
     long * c = va_arg(args, long*);
+    long expected = va_arg(args, long);
     for (long i = begin; i < end; ++i) {
-        if (c[i] != 3) {
-            LOG("VALIDATION ERROR: c[%li] == %li (supposed to be 3)\n", i, c[i]);
+        if (c[i] != expected) {
+            LOG("VALIDATION ERROR: c[%li] == %li (supposed to be %li)\n", i, c[i], expected);
             exit(1);
         }
     }
@@ -145,61 +245,141 @@ void
 local_stream_validate(local_stream_data * data)
 {
     emu_local_for(0, data->n, LOCAL_GRAIN(data->n),
-        local_stream_validate_worker, data->c
+        local_stream_validate_worker, data->c, stream_kernel_expected(data->kernel)
     );
 }
 
+static const struct option long_options[] = {
+    {"warmup"       , required_argument},
+    {"kernel"       , required_argument},
+    {"help"         , no_argument},
+    {NULL}
+};
+
+static void
+print_help(const char* argv0)
+{
+    LOG("Usage: %s [OPTIONS] mode log2_num_elements num_threads num_trials\n", argv0);
+    LOG("\t--warmup             Number of untimed trials to run first\n");
+    LOG("\t--kernel             STREAM kernel to run: copy, scale, add (default), or triad\n");
+    LOG("num_threads can be a list (8,16,32) or a range (8:512:x2, 8:64:+8) to sweep thread counts in one run\n");
+    LOG("\t--help               Print command line help\n");
+}
 
 int main(int argc, char** argv)
 {
     struct {
         const char* mode;
         long log2_num_elements;
-        long num_threads;
+        thread_sweep threads;
         long num_trials;
+        long num_warmup;
+        long kernel;
     } args;
+    args.num_warmup = 0;
+    args.kernel = STREAM_ADD;
 
-    if (argc != 5) {
-        LOG("Usage: %s mode log2_num_elements num_threads num_trials\n", argv[0]);
+    int option_index;
+    while (true)
+    {
+        int c = getopt_long(argc, argv, "", long_options, &option_index);
+        // Done parsing
+        if (c == -1) { break; }
+        // Parse error
+        if (c == '?') {
+            LOG("Invalid arguments\n");
+            print_help(argv[0]);
+            exit(1);
+        }
+        const char* option_name = long_options[option_index].name;
+
+        if (!strcmp(option_name, "warmup")) {
+            args.num_warmup = atol(optarg);
+        } else if (!strcmp(option_name, "kernel")) {
+            if (!stream_kernel_parse(optarg, &args.kernel)) {
+                LOG("Kernel %s not implemented!\n", optarg);
+                exit(1);
+            }
+        } else if (!strcmp(option_name, "help")) {
+            print_help(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 4) {
+        print_help(argv[0]);
         exit(1);
     } else {
-        args.mode = argv[1];
-        args.log2_num_elements = atol(argv[2]);
-        args.num_threads = atol(argv[3]);
-        args.num_trials = atol(argv[4]);
+        args.mode = argv[optind + 0];
+        args.log2_num_elements = atol(argv[optind + 1]);
+        args.threads = thread_sweep_parse(argv[optind + 2]);
+        args.num_trials = atol(argv[optind + 3]);
 
         if (args.log2_num_elements <= 0) { LOG("log2_num_elements must be > 0"); exit(1); }
-        if (args.num_threads <= 0) { LOG("num_threads must be > 0"); exit(1); }
         if (args.num_trials <= 0) { LOG("num_trials must be > 0"); exit(1); }
+        if (args.num_warmup < 0) { LOG("warmup must be >= 0"); exit(1); }
     }
 
+    hooks_set_attr_i64("num_warmup", args.num_warmup);
+    hooks_set_attr_str("kernel", stream_kernel_name(args.kernel));
+
     long n = 1L << args.log2_num_elements;
     LOG("Initializing arrays with %li elements each (%li MiB)\n",
         n, (n * sizeof(long)) / (1024*1024)); fflush(stdout);
     local_stream_data data;
-    data.num_threads = args.num_threads;
+    data.num_threads = args.threads.values[0];
+    data.kernel = args.kernel;
     local_stream_init(&data, n);
-    LOG("Doing vector addition using %s\n", args.mode); fflush(stdout);
-
-    #define RUN_BENCHMARK(X) local_stream_run(&data, args.mode, X, args.num_trials)
-
-    if (!strcmp(args.mode, "cilk_for")) {
-        RUN_BENCHMARK(local_stream_add_cilk_for);
-    } else if (!strcmp(args.mode, "serial_spawn")) {
-        RUN_BENCHMARK(local_stream_add_serial_spawn);
-    } else if (!strcmp(args.mode, "recursive_spawn")) {
-        RUN_BENCHMARK(local_stream_add_recursive_spawn);
-    } else if (!strcmp(args.mode, "library")) {
-        RUN_BENCHMARK(local_stream_add_library);
-    } else if (!strcmp(args.mode, "serial")) {
-        RUN_BENCHMARK(local_stream_add_serial);
-    } else {
-        LOG("Mode %s not implemented!", args.mode);
+    // Benchmark each thread count against the same arrays
+    double results[THREAD_SWEEP_MAX];
+    for (long t = 0; t < args.threads.count; ++t) {
+        long num_threads = args.threads.values[t];
+        data.num_threads = num_threads;
+        hooks_set_attr_i64("num_threads", num_threads);
+        LOG("Running %s kernel using %s with %li threads\n", stream_kernel_name(args.kernel), args.mode, num_threads);
+
+        double result = 0;
+        #define RUN_BENCHMARK(X) result = local_stream_run(&data, args.mode, X, args.num_trials, args.num_warmup)
+
+        if (!strcmp(args.mode, "first_touch")) {
+            result = local_stream_first_touch_run(&data, args.num_trials, args.num_warmup);
+        } else if (!strcmp(args.mode, "cilk_for")) {
+            RUN_BENCHMARK(local_stream_add_cilk_for);
+        } else if (!strcmp(args.mode, "serial_spawn")) {
+            RUN_BENCHMARK(local_stream_add_serial_spawn);
+        } else if (!strcmp(args.mode, "recursive_spawn")) {
+            RUN_BENCHMARK(local_stream_add_recursive_spawn);
+        } else if (!strcmp(args.mode, "library")) {
+            RUN_BENCHMARK(local_stream_add_library);
+#ifdef HAVE_STREAM_SIMD
+        } else if (!strcmp(args.mode, "simd")) {
+            RUN_BENCHMARK(local_stream_add_simd);
+        } else if (!strcmp(args.mode, "simd_nt")) {
+            RUN_BENCHMARK(local_stream_add_simd_nt);
+#endif
+        } else if (!strcmp(args.mode, "serial")) {
+            RUN_BENCHMARK(local_stream_add_serial);
+        } else {
+            LOG("Mode %s not implemented!", args.mode);
+            exit(1);
+        }
+        #undef RUN_BENCHMARK
+        results[t] = result;
+    }
+
+    if (args.threads.count > 1) {
+        LOG("Scaling curve for %s (median MB/s):\n", args.mode);
+        for (long t = 0; t < args.threads.count; ++t) {
+            LOG("%8li threads: %3.2f MB/s\n", args.threads.values[t], results[t]);
+        }
     }
 #ifndef NO_VALIDATE
-    LOG("Validating results...");
-    local_stream_validate(&data);
-    LOG("OK\n");
+    // first_touch mode only initializes the arrays, there is no result to check
+    if (strcmp(args.mode, "first_touch")) {
+        LOG("Validating results...");
+        local_stream_validate(&data);
+        LOG("OK\n");
+    }
 #endif
     local_stream_deinit(&data);
     return 0;
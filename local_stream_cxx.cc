@@ -8,6 +8,8 @@
 #include <emu_c_utils/emu_c_utils.h>
 #include <emu_cxx_utils/for_each.h>
 #include "common.h"
+#include "benchmark_driver.h"
+#include "stream_simd.h"
 
 using namespace emu;
 
@@ -106,18 +108,31 @@ struct local_stream {
         });
     }
 
+#ifdef HAVE_STREAM_SIMD
+    void
+    add_simd()
+    {
+        stream_simd_kernel(STREAM_ADD, c, a, b, 0, n);
+    }
+
+    void
+    add_simd_nt()
+    {
+        stream_simd_kernel_nt(STREAM_ADD, c, a, b, 0, n);
+    }
+#endif
+
     void
     run(const char * name, long num_trials)
     {
-        for (long trial = 0; trial < num_trials; ++trial) {
-            hooks_set_attr_i64("trial", trial);
-
-            double time_ms = 0;
-            #define RUN_BENCHMARK(X)            \
-            do {                                \
-                hooks_region_begin(name);       \
-                X();                            \
-                time_ms = hooks_region_end();   \
+        benchmark_driver driver;
+        benchmark_driver_init(&driver, name, num_trials, n * sizeof(long) * 3, "MB/s");
+        while (benchmark_driver_next(&driver)) {
+            #define RUN_BENCHMARK(X)                    \
+            do {                                        \
+                benchmark_driver_begin_trial(&driver);  \
+                X();                                    \
+                benchmark_driver_end_trial(&driver);    \
             } while(false)
 
             if (!strcmp(name, "serial")) {
@@ -132,15 +147,19 @@ struct local_stream {
                 RUN_BENCHMARK(add_dynamic);
             } else if (!strcmp(name, "fixed")) {
                 RUN_BENCHMARK(add_static);
+#ifdef HAVE_STREAM_SIMD
+            } else if (!strcmp(name, "simd")) {
+                RUN_BENCHMARK(add_simd);
+            } else if (!strcmp(name, "simd_nt")) {
+                RUN_BENCHMARK(add_simd_nt);
+#endif
             } else {
                 printf("Mode %s not implemented!", name);
                 exit(1);
             }
             #undef RUN_BENCHMARK
-            double mbytes_per_second = (1e-6 * n * sizeof(long) * 3)
-                                       / (1e-3 * time_ms);
-            LOG("%3.2f MB/s\n", mbytes_per_second);
         }
+        benchmark_driver_finish(&driver);
     }
 };
 
@@ -6,6 +6,7 @@
 #include <emu_c_utils/emu_c_utils.h>
 
 #include "common.h"
+#include "benchmark_driver.h"
 #if defined(__EMU_CC__) && defined(WAKEUP)
 #include "queue_lock.h"
 #endif
@@ -183,18 +184,17 @@ void run_test(long n, long num_threads, long num_trials)
     }
     Mutex mutex;
     volatile double counter;
-    for (long trial = 0; trial < num_trials; ++trial) {
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "allocation", num_trials, n,
+        "million lock acquires per second");
+    while (benchmark_driver_next(&driver)) {
         counter = 0;
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin("allocation");
+        benchmark_driver_begin_trial(&driver);
         for (long i = 0; i < num_threads; ++i){
             cilk_spawn worker(mutex, &counter, n_per_thread);
         }
         cilk_sync;
-        double time_ms = hooks_region_end();
-        double locks_per_second = n / (time_ms/1000);
-        LOG("%3.2f million lock acquires per second\n",
-            locks_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
 
 #ifndef NO_VALIDATE
         long counter_val = static_cast<long>(counter);
@@ -203,6 +203,7 @@ void run_test(long n, long num_threads, long num_trials)
         }
 #endif
     }
+    benchmark_driver_finish(&driver);
 }
 
 int main(int argc, char** argv)
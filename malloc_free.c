@@ -7,6 +7,7 @@
 #include <string.h>
 
 #include "common.h"
+#include "benchmark_driver.h"
 
 #include <emu_c_utils/emu_c_utils.h>
 
@@ -44,15 +45,14 @@ void malloc_free_run(
     void (*benchmark)(malloc_free_data *),
     long num_trials)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin("malloc_free");
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "malloc_free", num_trials, data->n, "million mallocs per second");
+    while (benchmark_driver_next(&driver)) {
+        benchmark_driver_begin_trial(&driver);
         benchmark(data);
-        double time_ms = hooks_region_end();
-        double mallocs_per_second = time_ms == 0 ? 0 :
-            (data->n) / (time_ms/1000);
-        LOG("%3.2f million mallocs per second\n", mallocs_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
     }
+    benchmark_driver_finish(&driver);
 }
 
 int main(int argc, char** argv)
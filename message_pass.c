@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <cilk/cilk.h>
+#ifndef __le64__
+#include <cilk/cilk_api.h>
+#endif
+#include <emu_c_utils/emu_c_utils.h>
+
+#include "clock_rate.h"
+
+// largest payload is 512 bytes
+#define MAX_PAYLOAD_WORDS 64
+#define MAX_THREADS 64
+// migrate mode carries the payload in scalar locals, which fit in the thread context,
+// so larger payloads are carried this many words per migration
+#define MAX_CARRIED_WORDS 8
+
+replicated long num_messages;
+replicated long payload_words;
+// one mailbox per thread on every nodelet
+replicated long mailboxes[MAX_THREADS][MAX_PAYLOAD_WORDS];
+
+enum message_mode { MODE_REMOTE, MODE_MIGRATE };
+
+// mailbox of thread i on a nodelet
+static inline long *mailbox(long nlet, long i)
+{
+  return (long *)mw_get_nth(mailboxes, nlet) + i * MAX_PAYLOAD_WORDS;
+}
+
+// word w of message m; every word is unique, so polling sees when all of them have arrived
+static inline long message_word(long m, long w)
+{
+  return m * MAX_PAYLOAD_WORDS + w;
+}
+
+// remote writes: store message m into a mailbox on another nodelet without migrating
+static inline void send_remote(long *box, long m, long words)
+{
+  for (long w = 0; w < words; ++w) box[w] = message_word(m, w);
+}
+
+// poll the local mailbox until every word of message m has arrived
+static inline void poll_local(long *box, long m, long words)
+{
+  for (long w = 0; w < words; ++w) {
+    while (((volatile long *)box)[w] != message_word(m, w)) RESCHEDULE();
+  }
+}
+
+// producer on src: sends message m to dst, waits for dst to send it back
+void producer_remote(long *srcbox, long *dstbox)
+{
+  long n = num_messages, words = payload_words;
+  for (long m = 1; m <= n; ++m) {
+    send_remote(dstbox, m, words);
+    poll_local(srcbox, m, words);
+  }
+}
+
+// consumer on dst: waits for message m, sends it back to src
+void consumer_remote(long *srcbox, long *dstbox)
+{
+  long n = num_messages, words = payload_words;
+  for (long m = 1; m <= n; ++m) {
+    poll_local(dstbox, m, words);
+    send_remote(srcbox, m, words);
+  }
+}
+
+// store / load the first words of a segment of the payload p0..p7 (an array would live in stack memory, not registers)
+#define STORE_CARRIED(box, words) do { \
+  switch (words) { \
+  case 8: (box)[7] = p7; /* fallthrough */ \
+  case 7: (box)[6] = p6; /* fallthrough */ \
+  case 6: (box)[5] = p5; /* fallthrough */ \
+  case 5: (box)[4] = p4; /* fallthrough */ \
+  case 4: (box)[3] = p3; /* fallthrough */ \
+  case 3: (box)[2] = p2; /* fallthrough */ \
+  case 2: (box)[1] = p1; /* fallthrough */ \
+  default: (box)[0] = p0; \
+  } } while (0)
+#define LOAD_CARRIED(box, words) do { \
+  switch (words) { \
+  case 8: p7 = (box)[7]; /* fallthrough */ \
+  case 7: p6 = (box)[6]; /* fallthrough */ \
+  case 6: p5 = (box)[5]; /* fallthrough */ \
+  case 5: p4 = (box)[4]; /* fallthrough */ \
+  case 4: p3 = (box)[3]; /* fallthrough */ \
+  case 3: p2 = (box)[2]; /* fallthrough */ \
+  case 2: p1 = (box)[1]; /* fallthrough */ \
+  default: p0 = (box)[0]; \
+  } } while (0)
+
+// migration: load the payload into registers, carry it to the other nodelet, store it there
+// payloads larger than MAX_CARRIED_WORDS travel in segments, one migration each, and the thread
+// goes back for the next segment
+void carrier_migrate(long *srcbox, long *dstbox)
+{
+  long n = num_messages, words = payload_words;
+  long p0, p1, p2, p3, p4, p5, p6, p7;
+  for (long m = 1; m <= n; ++m) {
+    for (long w = 0; w < words; w += MAX_CARRIED_WORDS) {
+      long seg = words - w < MAX_CARRIED_WORDS ? words - w : MAX_CARRIED_WORDS;
+      MIGRATE(srcbox);
+      p0 = message_word(m, w); p1 = message_word(m, w + 1); p2 = message_word(m, w + 2); p3 = message_word(m, w + 3);
+      p4 = message_word(m, w + 4); p5 = message_word(m, w + 5); p6 = message_word(m, w + 6); p7 = message_word(m, w + 7);
+      MIGRATE(dstbox);
+      STORE_CARRIED(dstbox + w, seg);
+    }
+    // the reply is read from the dst mailbox and carried back
+    for (long w = 0; w < words; w += MAX_CARRIED_WORDS) {
+      long seg = words - w < MAX_CARRIED_WORDS ? words - w : MAX_CARRIED_WORDS;
+      MIGRATE(dstbox);
+      LOAD_CARRIED(dstbox + w, seg);
+      MIGRATE(srcbox);
+      STORE_CARRIED(srcbox + w, seg);
+    }
+  }
+}
+
+// one trial: nth threads exchange num_messages messages each way between src and dst
+// returns elapsed cycles, measured on src
+noinline long message_pass_spawn(long src_nlet, long dst_nlet, long nth, long mode)
+{
+  // clear the mailboxes so that stale words from the last trial can't match
+  for (long i = 0; i < nth; ++i) {
+    memset(mailbox(src_nlet, i), 0, MAX_PAYLOAD_WORDS * sizeof(long));
+    memset(mailbox(dst_nlet, i), 0, MAX_PAYLOAD_WORDS * sizeof(long));
+  }
+  MIGRATE(mailbox(src_nlet, 0));
+  volatile unsigned long starttime = CLOCK();
+  for (long i = 0; i < nth; ++i) {
+    long *srcbox = mailbox(src_nlet, i);
+    long *dstbox = mailbox(dst_nlet, i);
+    if (mode == MODE_REMOTE) {
+      cilk_spawn_at(dstbox) consumer_remote(srcbox, dstbox);
+      cilk_spawn producer_remote(srcbox, dstbox);
+    } else {
+      cilk_spawn carrier_migrate(srcbox, dstbox);
+    }
+  }
+  cilk_sync;
+  MIGRATE(mailbox(src_nlet, 0));
+  volatile unsigned long endtime = CLOCK();
+  return endtime - starttime;
+}
+
+int main(int argc, char** argv)
+{
+  // default src<->dst, log2 messages each way, threads, trials, payload range in bytes
+  long src = 0, dst = 1, log2_num = 8, nth = 1, ntr = 2, min_bytes = 8, max_bytes = 512;
+  const char *mode_name = "both";
+  // Emu Chick cores run at 175 MHz, native clocks are measured (0 = auto-detect)
+#ifdef __le64__
+  double clock_mhz = 175.0;
+#else
+  double clock_mhz = 0;
+#endif
+  int c;
+  while ((c = getopt(argc, argv, "hs:d:m:t:r:b:B:M:f:")) != -1) {
+    switch (c) {
+    case 'h':
+      printf("Program options:\n");
+      printf("\t-h print this help and exit\n");
+      printf("\t-s <N> source nodelet [%ld]\n", src);
+      printf("\t-d <N> dest nodelet [%ld]\n", dst);
+      printf("\t-m <N> log2 messages each way per thread [%ld]\n", log2_num);
+      printf("\t-t <N> number of thread pairs, each with its own mailbox [%ld]\n", nth);
+      printf("\t-r <N> number of trials [%ld]\n", ntr);
+      printf("\t-b <N> smallest payload in bytes [%ld]\n", min_bytes);
+      printf("\t-B <N> largest payload in bytes, doubling from the smallest [%ld]\n", max_bytes);
+      printf("\t-M <remote|migrate|both> how messages are moved [%s]\n", mode_name);
+      printf("\t-f <MHz> clock rate used to convert cycles to time (0 = auto-detect) [%g]\n", clock_mhz);
+      exit(0);
+    case 's': src = atol(optarg); break;
+    case 'd': dst = atol(optarg); break;
+    case 'm': log2_num = atol(optarg); break;
+    case 't': nth = atol(optarg); break;
+    case 'r': ntr = atol(optarg); break;
+    case 'b': min_bytes = atol(optarg); break;
+    case 'B': max_bytes = atol(optarg); break;
+    case 'M': mode_name = optarg; break;
+    case 'f': clock_mhz = atof(optarg); break;
+    }
+  }
+
+  // check bounds on parameters
+  if (src < 0 || src >= (long)NODELETS()) { printf("src_nlet out of range\n"); exit(1); }
+  if (dst < 0 || dst >= (long)NODELETS()) { printf("dst_nlet out of range\n"); exit(1); }
+  if (src == dst) { printf("src and dst must be different nodelets\n"); exit(1); }
+  if (log2_num < 0) { printf("log2 num_messages must be >= 0\n"); exit(1); }
+  if (nth <= 0 || nth > MAX_THREADS) { printf("num_threads must be between 1 and %d\n", MAX_THREADS); exit(1); }
+  if (ntr <= 0) { printf("num_trials must be > 0\n"); exit(1); }
+  if (min_bytes < 8 || min_bytes % 8 || max_bytes % 8) { printf("payload must be a multiple of 8 bytes\n"); exit(1); }
+  if (max_bytes < min_bytes || max_bytes > MAX_PAYLOAD_WORDS * 8) {
+    printf("largest payload must be between %ld and %d bytes\n", min_bytes, MAX_PAYLOAD_WORDS * 8); exit(1); }
+  long first_mode, last_mode;
+  if (!strcmp(mode_name, "remote")) first_mode = last_mode = MODE_REMOTE;
+  else if (!strcmp(mode_name, "migrate")) first_mode = last_mode = MODE_MIGRATE;
+  else if (!strcmp(mode_name, "both")) { first_mode = MODE_REMOTE; last_mode = MODE_MIGRATE; }
+  else { printf("unknown mode %s\n", mode_name); exit(1); }
+  if (clock_mhz < 0) { printf("clock rate must be >= 0\n"); exit(1); }
+#ifndef __le64__
+  // native spawns don't create threads: every producer and consumer spins on its own Cilk worker
+  if (first_mode == MODE_REMOTE && 2 * nth > __cilkrts_get_nworkers()) {
+    printf("remote mode with %ld thread pairs needs at least %ld Cilk workers, have %d (set CILK_NWORKERS)\n",
+	   nth, 2 * nth, __cilkrts_get_nworkers());
+    exit(1);
+  }
+#endif
+  if (clock_mhz == 0) clock_mhz = detect_clock_mhz();
+
+  // log variables for the run
+  long n = 1L << log2_num;
+  printf("message pass: num nodelets %ld\n", NODELETS());
+  printf("message pass: src nlet %ld\n", src);
+  printf("message pass: dst nlet %ld\n", dst);
+  printf("message pass: num messages %ld\n", n);
+  printf("message pass: num threads %ld\n", nth);
+  printf("message pass: num trials %ld\n", ntr);
+  printf("message pass: payload bytes %ld to %ld\n", min_bytes, max_bytes);
+  printf("message pass: mode %s\n", mode_name);
+  if (last_mode == MODE_MIGRATE && max_bytes > MAX_CARRIED_WORDS * 8)
+    printf("message pass: migrate mode carries %d bytes per migration, larger payloads take several\n",
+	   MAX_CARRIED_WORDS * 8);
+  printf("message pass: clock MHz %f\n", clock_mhz);
+  fflush(stdout);
+
+  // replicated variables so no migrations for loop bounds
+  mw_replicated_init(&num_messages, n);
+
+  // each message is one-way, so a round trip is two messages
+  starttiming();
+  printf("mode payload_bytes cycles latency_us million_msgs_per_s MB_per_s\n");
+  for (long mode = first_mode; mode <= last_mode; ++mode) {
+    for (long bytes = min_bytes; bytes <= max_bytes; bytes *= 2) {
+      mw_replicated_init(&payload_words, bytes / 8);
+      long cycles = 0;
+      for (long r = 0; r < ntr; ++r) cycles += message_pass_spawn(src, dst, nth, mode);
+      double time_us = (double)cycles / (ntr * clock_mhz);
+      double latency_us = time_us / (2 * n);
+      double million_mps = (double)(2 * n * nth) / time_us;
+      printf("%s %ld %ld %f %f %f\n", mode == MODE_REMOTE ? "remote" : "migrate", bytes,
+	     cycles / ntr, latency_us, million_mps, million_mps * bytes);
+      // a largest payload between powers of two still gets measured
+      if (bytes < max_bytes && bytes * 2 > max_bytes) bytes = max_bytes / 2;
+    }
+  }
+
+  return 0;
+}
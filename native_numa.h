@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * NUMA placement for native (x86) builds
+ *
+ * On x86, emu_c_utils implements mw_malloc2d, mw_malloc1dlong, mw_mallocrepl and cilk_spawn_at
+ * on top of a single memory pool, so "remote" accesses are just as fast as local ones.
+ * When built with ENABLE_NUMA, these helpers map nodelet i onto NUMA node (i % num_nodes),
+ * bind memory to nodes with mbind, and pin the calling worker to the CPUs of a node,
+ * so that the remote-spawn modes measure local vs. remote bandwidth on multi-socket hosts.
+ *
+ * Cilk workers are shared by every task, so a worker is only pinned for the duration of a leaf task
+ * (one that doesn't spawn) and is restored with native_unpin before the task returns.
+ * Pinning a task that spawns would leave whichever worker ran the child pinned after a steal.
+ *
+ * Pinning happens inside the timed region, so everything else is done ahead of time: the node of each
+ * chunk of data is looked up once at init (native_numa_node_of), and the CPU mask of every node is built
+ * the first time NUMA is used. A pin or unpin is then a single sched_setaffinity call. The time spent
+ * in them is accumulated so that benchmarks can report it separately (native_pin_overhead_ms).
+ *
+ * On Emu, or when libnuma is not available, all of these are no-ops.
+ */
+
+#if !defined(__le64__) && defined(USE_NUMA)
+
+#include <stdlib.h>
+#include <time.h>
+#include <numa.h>
+#include <numaif.h>
+#include <unistd.h>
+
+// Nanoseconds spent in native_pin_to_node and native_unpin, summed over all workers
+static long native_pin_ns = 0;
+
+static inline long
+native_now_ns(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static inline void
+native_pin_overhead_reset(void)
+{
+    __atomic_store_n(&native_pin_ns, 0, __ATOMIC_RELAXED);
+}
+
+// Total time all workers spent pinning and unpinning since the last reset
+static inline double
+native_pin_overhead_ms(void)
+{
+    return __atomic_load_n(&native_pin_ns, __ATOMIC_RELAXED) / 1e6;
+}
+
+// CPUs of each NUMA node, and the CPUs the process started with, built once by native_numa_enabled
+static struct bitmask ** native_node_cpus = NULL;
+static struct bitmask * native_all_cpus = NULL;
+
+static inline bool
+native_numa_enabled(void)
+{
+    static int available = -2;
+    if (available == -2) {
+        available = numa_available();
+        if (available >= 0) {
+            native_all_cpus = numa_allocate_cpumask();
+            numa_sched_getaffinity(0, native_all_cpus);
+            native_node_cpus = malloc(sizeof(struct bitmask *) * (numa_max_node() + 1));
+            for (int node = 0; node <= numa_max_node(); ++node) {
+                native_node_cpus[node] = numa_allocate_cpumask();
+                numa_node_to_cpus(node, native_node_cpus[node]);
+            }
+        }
+    }
+    return available >= 0;
+}
+
+// NUMA node that corresponds to a nodelet
+static inline int
+native_numa_node(long nlet)
+{
+    return (int)(nlet % (numa_max_node() + 1));
+}
+
+// mbind requires page-aligned ranges, so only whole pages inside [ptr, ptr + bytes) are bound
+static inline bool
+native_page_range(void * ptr, size_t bytes, void ** begin, size_t * length)
+{
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)ptr + page - 1) & ~(page - 1);
+    uintptr_t last = ((uintptr_t)ptr + bytes) & ~(page - 1);
+    if (last <= first) { return false; }
+    *begin = (void*)first;
+    *length = last - first;
+    return true;
+}
+
+// Place a range of memory on the NUMA node for this nodelet. Must be called before first touch.
+static inline void
+native_place_on_nodelet(void * ptr, size_t bytes, long nlet)
+{
+    void * begin; size_t length;
+    if (!native_numa_enabled() || !native_page_range(ptr, bytes, &begin, &length)) { return; }
+    numa_tonode_memory(begin, length, native_numa_node(nlet));
+}
+
+// NUMA node where ptr lives, or -1. Call at init, after the memory has been touched.
+static inline int
+native_numa_node_of(void * ptr)
+{
+    int node = -1;
+    if (!native_numa_enabled()) { return -1; }
+    if (get_mempolicy(&node, NULL, 0, ptr, MPOL_F_NODE | MPOL_F_ADDR) != 0) { return -1; }
+    return node;
+}
+
+// NUMA node for a nodelet's chunk placed with native_place_on_nodelet, or -1
+static inline int
+native_nodelet_node(long nlet)
+{
+    return native_numa_enabled() ? native_numa_node(nlet) : -1;
+}
+
+// Whether the worker was pinned by native_pin_to_node
+typedef struct native_affinity {
+    bool pinned;
+} native_affinity;
+
+// Pin the calling worker to the CPUs of a NUMA node (native cilk_spawn_at), does nothing if node is -1
+// Only call this from a leaf task, and pass the result to native_unpin before it returns
+static inline native_affinity
+native_pin_to_node(int node)
+{
+    native_affinity saved = { false };
+    if (node < 0 || native_node_cpus == NULL) { return saved; }
+    long start = native_now_ns();
+    saved.pinned = numa_sched_setaffinity(0, native_node_cpus[node]) == 0;
+    __atomic_fetch_add(&native_pin_ns, native_now_ns() - start, __ATOMIC_RELAXED);
+    return saved;
+}
+
+// Give the worker back the CPUs the process started with
+static inline void
+native_unpin(native_affinity saved)
+{
+    if (!saved.pinned) { return; }
+    long start = native_now_ns();
+    numa_sched_setaffinity(0, native_all_cpus);
+    __atomic_fetch_add(&native_pin_ns, native_now_ns() - start, __ATOMIC_RELAXED);
+}
+
+#else
+
+typedef struct native_affinity {
+    bool pinned;
+} native_affinity;
+
+static inline bool native_numa_enabled(void) { return false; }
+static inline void native_place_on_nodelet(void * ptr, size_t bytes, long nlet) { (void)ptr; (void)bytes; (void)nlet; }
+static inline int native_numa_node_of(void * ptr) { (void)ptr; return -1; }
+static inline int native_nodelet_node(long nlet) { (void)nlet; return -1; }
+static inline native_affinity native_pin_to_node(int node) { (void)node; native_affinity saved = { false }; return saved; }
+static inline void native_unpin(native_affinity saved) { (void)saved; }
+static inline void native_pin_overhead_reset(void) { }
+static inline double native_pin_overhead_ms(void) { return 0; }
+
+#endif
@@ -1,12 +1,26 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <getopt.h>
 #include <cilk/cilk.h>
+#ifndef __le64__
+#include <cilk/cilk_api.h>
+#endif
 #include <emu_c_utils/emu_c_utils.h>
 
+#include "clock_rate.h"
+
 replicated long num_migrations;
 replicated long num_threads;
 replicated long **results;
+// background load: set to 1 to stop the background threads, bytes moved on each nodelet
+replicated long background_stop;
+replicated long background_bytes;
+
+enum background_load { LOAD_NONE, LOAD_STREAM, LOAD_COPY };
+
+// thread sweep: the knee is the last thread count that raised throughput by at least this fraction
+#define SWEEP_KNEE_GAIN 0.10
 
 // ping pong function: starts at src, migrates 4 times to/from dst
 void ping_pong(long *srcptr, long *dstptr)
@@ -21,6 +35,13 @@ void ping_pong(long *srcptr, long *dstptr)
   }
 }
 
+// ping pong, then record when this thread finished (back on src, so the clock matches the spawner's)
+void ping_pong_timed(long *srcptr, long *dstptr, long *finish)
+{
+  ping_pong(srcptr, dstptr);
+  *finish = CLOCK();
+}
+
 // spawn threads for ping pong, compute elapsed time (cycles)
 noinline long ping_pong_spawn(long *srcptr, long *dstptr)
 {
@@ -69,17 +90,202 @@ void ping_pong_spawn_all(long src_nlet, long dst_nlet)
   }
 }
 
+// all-to-all ping_pong, running disjoint pairs at the same time, params not used
+// Round-robin tournament (circle method): nodelet slots-1 stays put while the others rotate,
+// so every pair meets exactly once in slots-1 rounds, and no nodelet is in two pairs of a round
+void ping_pong_spawn_concurrent(long src_nlet, long dst_nlet)
+{
+  long slots = NODELETS() + (NODELETS() & 1); // add a bye if odd
+  for (long round = 0; round < slots - 1; ++round) {
+    for (long k = 0; k < slots / 2; ++k) {
+      long a = (k == 0) ? slots - 1 : (round + k) % (slots - 1);
+      long b = (round + slots - 1 - k) % (slots - 1);
+      if (a >= NODELETS() || b >= NODELETS()) { continue; } // sit out this round
+      // Same orientation as ping_pong_spawn_all, src < dst
+      if (a < b) cilk_spawn ping_pong_spawn_nlet(a, b);
+      else cilk_spawn ping_pong_spawn_nlet(b, a);
+    }
+    cilk_sync;
+  }
+}
+
+// sweep the number of threads on one pair, doubling up to max_threads, and report
+// per-thread completion times and the aggregate migration rate; the knee is where the rate stops growing
+noinline void ping_pong_sweep(long src_nlet, long dst_nlet, long max_threads, long ntr,
+			      double clock_mhz, const char *thread_file)
+{
+  long *srcptr = mw_get_nth(&num_migrations, src_nlet);
+  long *dstptr = mw_get_nth(&num_migrations, dst_nlet);
+  long *finish = mw_localmalloc(max_threads * sizeof(long), srcptr);
+  if (finish == NULL) { printf("could not allocate completion times\n"); exit(1); }
+  FILE *fp = NULL;
+  if (thread_file != NULL) {
+    fp = fopen(thread_file, "w");
+    if (fp == NULL) { printf("could not open %s\n", thread_file); exit(1); }
+    fprintf(fp, "threads,trial,thread,completion_us\n");
+  }
+
+  double best_mmps = 0, prev_mmps = 0;
+  long best_threads = 0, knee_threads = 0, prev_threads = 0;
+  printf("threads cycles million_mps min_thread_us mean_thread_us max_thread_us\n");
+  for (long t = 1; ; t = (2 * t < max_threads) ? 2 * t : max_threads) {
+    long total = 0, tmin = 0, tmax = 0;
+    double tmean = 0;
+    for (long r = 0; r < ntr; ++r) {
+      MIGRATE(srcptr);
+      volatile unsigned long starttime = CLOCK();
+      for (long i = 0; i < t; ++i) cilk_spawn ping_pong_timed(srcptr, dstptr, &finish[i]);
+      cilk_sync;
+      volatile unsigned long endtime = CLOCK();
+      total += endtime - starttime;
+      long lo = finish[0] - starttime, hi = lo;
+      for (long i = 0; i < t; ++i) {
+	long cycles = finish[i] - starttime;
+	if (cycles < lo) lo = cycles;
+	if (cycles > hi) hi = cycles;
+	tmean += (double)cycles / t;
+	if (fp) fprintf(fp, "%ld,%ld,%ld,%f\n", t, r, i, cycles / clock_mhz);
+      }
+      tmin += lo;
+      tmax += hi;
+    }
+    // migrations per microsecond = million migrations per second
+    double mmps = (double)(t * num_migrations * ntr) / (total / clock_mhz);
+    printf("%ld %ld %f %f %f %f\n", t, total / ntr, mmps,
+	   tmin / (ntr * clock_mhz), tmean / (ntr * clock_mhz), tmax / (ntr * clock_mhz));
+    if (knee_threads == 0 && t > 1 && mmps < prev_mmps * (1 + SWEEP_KNEE_GAIN)) knee_threads = prev_threads;
+    if (mmps > best_mmps) { best_mmps = mmps; best_threads = t; }
+    prev_mmps = mmps;
+    prev_threads = t;
+    if (t == max_threads) break;
+  }
+
+  if (knee_threads) printf("ping pong: knee at %ld threads\n", knee_threads);
+  else printf("ping pong: no knee up to %ld threads, throughput still growing\n", max_threads);
+  printf("ping pong: peak %f million migrations/s with %ld threads (%f per thread)\n",
+	 best_mmps, best_threads, best_mmps / best_threads);
+  if (fp) { fclose(fp); printf("ping pong: wrote per-thread completion times to %s\n", thread_file); }
+  mw_localfree(finish);
+}
+
+// background load thread: c = a + b over arrays on this nodelet (stream),
+// or c = a with c on another nodelet (copy, b is NULL), until background_stop is set
+void background_worker(long *a, long *b, long *c, long len)
+{
+  long passes = 0;
+  while (!*(volatile long *)&background_stop) {
+    if (b) for (long i = 0; i < len; ++i) c[i] = a[i] + b[i];
+    else for (long i = 0; i < len; ++i) c[i] = a[i];
+    passes++;
+  }
+  REMOTE_ADD(&background_bytes, passes * len * (b ? 3 : 2) * (long)sizeof(long));
+}
+
+// run all the trials, accumulating cycles into results
+void run_trials(long src, long dst, long ntr, long concurrent)
+{
+  for (long r = 0; r < ntr; ++r) {
+    // 3 modes for benchmark depending on src/dst arguments
+    if (concurrent) ping_pong_spawn_concurrent(src, dst);
+    else if ((src < 0) && (dst < 0)) ping_pong_spawn_all(src, dst);
+    else if ((src < 0) || (dst < 0)) ping_pong_spawn_dist(src, dst);
+    else ping_pong_spawn_nlet(src, dst);
+  }
+}
+
+// run all the trials while background threads stream through memory on the loaded nodelets
+// returns the offered load in MB/s
+noinline double run_loaded(long src, long dst, long ntr, long concurrent, long load,
+			   const char *loaded, long bth, long len, double clock_mhz)
+{
+  // each loaded nodelet gets 3 arrays (a, b, c) of len elements
+  long **blocks = malloc(NODELETS() * sizeof(long *));
+  for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+    blocks[nlet] = mw_localmalloc(3 * len * sizeof(long), mw_get_nth(&background_bytes, nlet));
+    if (blocks[nlet] == NULL) { printf("could not allocate background arrays\n"); exit(1); }
+    memset(blocks[nlet], 0, 3 * len * sizeof(long));
+  }
+  mw_replicated_init(&background_stop, 0);
+  mw_replicated_init(&background_bytes, 0);
+
+  MIGRATE(results[0]);
+  unsigned long starttime = CLOCK();
+  for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+    if (!loaded[nlet]) continue;
+    long *a = blocks[nlet];
+    long *b = (load == LOAD_STREAM) ? a + len : NULL;
+    // copy writes into the c array of the next nodelet
+    long *c = (load == LOAD_STREAM) ? a + 2 * len : blocks[(nlet + 1) % NODELETS()] + 2 * len;
+    for (long t = 0; t < bth; ++t) cilk_spawn_at(a) background_worker(a, b, c, len);
+  }
+  run_trials(src, dst, ntr, concurrent);
+  MIGRATE(results[0]);
+  unsigned long cycles = CLOCK() - starttime;
+  mw_replicated_init(&background_stop, 1);
+  cilk_sync;
+
+  long bytes = 0;
+  for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+    bytes += *(long *)mw_get_nth(&background_bytes, nlet);
+    mw_localfree(blocks[nlet]);
+  }
+  free(blocks);
+  // bytes per microsecond = MB/s
+  return cycles == 0 ? 0 : (double)bytes / ((double)cycles / clock_mhz);
+}
+
+// print how much the background load slowed down each pair
+void print_inflation(long *baseline, long ntr, double clock_mhz, double offered_mbps, long num_loaded)
+{
+  printf("background load: offered %f MB/s total, %f MB/s per loaded nodelet\n",
+	 offered_mbps, num_loaded ? offered_mbps / num_loaded : 0);
+  printf("source dest idle_latency_us loaded_latency_us inflation\n");
+  for (long i = 0; i < NODELETS(); ++i) {
+    for (long j = 0; j < NODELETS(); ++j) {
+      long idle = baseline[i * NODELETS() + j];
+      long loaded = results[i][j];
+      if (idle > 0 && loaded > 0) {
+	double idle_us = (double)idle / (ntr * clock_mhz * num_migrations);
+	double loaded_us = (double)loaded / (ntr * clock_mhz * num_migrations);
+	printf("%ld %ld %f %f %f\n", i, j, idle_us, loaded_us, loaded_us / idle_us);
+      }
+    }
+  }
+}
+
+// write the latency (us) between each pair of nodelets as a NODELETS() x NODELETS() CSV matrix
+// each pair is measured in one direction, so the matrix is mirrored; 0 on the diagonal, nan if not measured
+void write_matrix(const char *filename, long ntr, double clock_mhz)
+{
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL) { printf("could not open %s\n", filename); exit(1); }
+  fprintf(fp, "# ping_pong latency_us: num_migrations %ld num_threads %ld num_trials %ld clock_mhz %f\n",
+	  num_migrations, num_threads, ntr, clock_mhz);
+  for (long i = 0; i < NODELETS(); ++i) {
+    for (long j = 0; j < NODELETS(); ++j) {
+      long cycles = results[i][j] > 0 ? results[i][j] : results[j][i];
+      double latency_us = (double)cycles / (ntr * clock_mhz * num_migrations);
+      if (i == j) fprintf(fp, "%s0", j ? "," : "");
+      else if (cycles == 0) fprintf(fp, "%snan", j ? "," : "");
+      else fprintf(fp, "%s%f", j ? "," : "", latency_us);
+    }
+    fprintf(fp, "\n");
+  }
+  fclose(fp);
+  printf("ping pong: wrote latency matrix to %s\n", filename);
+}
+
 // gather output; must be noinline or ping_pong doesn't work
-noinline void gather(long ntr)
+noinline void gather(long ntr, double clock_mhz)
 {
   printf("source dest cycles avg_time_ms million_mps latency_us\n");
   for (long i = 0; i < NODELETS(); ++i) {
     for (long j = 0; j < NODELETS(); ++j) {
       if (results[i][j] > 0) {
 	long cycles = results[i][j];
-	double time_ms = (double)cycles / (ntr * 175.0 * 1e3);
+	double time_ms = (double)cycles / (ntr * clock_mhz * 1e3);
 	double million_mps = (double)num_migrations / (time_ms * 1e3);
-	double latency_us = (double)1e6 / million_mps;
+	double latency_us = 1.0 / million_mps;
 	printf("%ld %ld %ld %f %f %f\n", i, j,
 	       cycles, time_ms, million_mps, latency_us);
       }
@@ -90,9 +296,22 @@ noinline void gather(long ntr)
 int main(int argc, char** argv)
 {
   // default src<->dst, log2 migrations (4 per iteration), threads, trials
-  long src = 1, dst = 2, log2_num = 3, nth = 2, ntr = 2;
+  long src = 1, dst = 2, log2_num = 3, nth = 2, ntr = 2, concurrent = 0;
+  // thread sweep: max threads (0 = no sweep), per-thread completion time file
+  long sweep = 0;
+  const char *thread_file = NULL;
+  const char *matrix_file = NULL;
+  // background load: type, threads per loaded nodelet, log2 elements per array, loaded nodelets
+  long load = LOAD_NONE, bth = 1, log2_len = 14;
+  const char *load_name = "none", *load_list = NULL;
+  // Emu Chick cores run at 175 MHz, native clocks are measured (0 = auto-detect)
+#ifdef __le64__
+  double clock_mhz = 175.0;
+#else
+  double clock_mhz = 0;
+#endif
   int c;
-  while ((c = getopt(argc, argv, "hs:d:m:t:r:")) != -1) {
+  while ((c = getopt(argc, argv, "hs:d:m:t:r:cf:o:l:b:L:z:w:p:")) != -1) {
     switch (c) {
     case 'h':
       printf("Program options:\n");
@@ -102,12 +321,30 @@ int main(int argc, char** argv)
       printf("\t-m <N> log2_num_migrations [%ld]\n", log2_num);
       printf("\t-t <N> number of threads [%ld]\n", nth);
       printf("\t-r <N> number of trials [%ld]\n", ntr);
+      printf("\t-c with -s -1 -d -1, run disjoint pairs at the same time\n");
+      printf("\t-f <MHz> clock rate used to convert cycles to time (0 = auto-detect) [%g]\n", clock_mhz);
+      printf("\t-o <file> write the latency matrix to this file\n");
+      printf("\t-l <none|stream|copy> background load while measuring [%s]\n", load_name);
+      printf("\t-b <N> background threads per loaded nodelet [%ld]\n", bth);
+      printf("\t-L <N,N,...> nodelets to load [all]\n");
+      printf("\t-z <N> log2 elements in each background array [%ld]\n", log2_len);
+      printf("\t-w <N> sweep 1, 2, 4, ... N threads on the src/dst pair and find the knee\n");
+      printf("\t-p <file> with -w, write per-thread completion times to this file\n");
       exit(0);
     case 's': src = atol(optarg); break;
     case 'd': dst = atol(optarg); break;
     case 'm': log2_num = atol(optarg); break;
     case 't': nth = atol(optarg); break;
     case 'r': ntr = atol(optarg); break;
+    case 'c': concurrent = 1; break;
+    case 'f': clock_mhz = atof(optarg); break;
+    case 'o': matrix_file = optarg; break;
+    case 'l': load_name = optarg; break;
+    case 'b': bth = atol(optarg); break;
+    case 'L': load_list = optarg; break;
+    case 'z': log2_len = atol(optarg); break;
+    case 'w': sweep = atol(optarg); break;
+    case 'p': thread_file = optarg; break;
     }
   }
   
@@ -117,6 +354,38 @@ int main(int argc, char** argv)
   if (log2_num <= 1) { printf("num_migrations must be >= 4\n"); exit(1); }
   if (nth <= 0) { printf("num_threads must be > 0\n"); exit(1); }
   if (ntr <= 0) { printf("num_trials must be > 0\n"); exit(1); }
+  if (concurrent && (src >= 0 || dst >= 0)) { printf("-c requires -s -1 -d -1\n"); exit(1); }
+  if (clock_mhz < 0) { printf("clock rate must be >= 0\n"); exit(1); }
+  if (sweep < 0) { printf("sweep threads must be > 0\n"); exit(1); }
+  if (sweep && (src < 0 || dst < 0 || src == dst)) { printf("-w requires distinct -s and -d >= 0\n"); exit(1); }
+  if (clock_mhz == 0) clock_mhz = detect_clock_mhz();
+  if (!strcmp(load_name, "none")) load = LOAD_NONE;
+  else if (!strcmp(load_name, "stream")) load = LOAD_STREAM;
+  else if (!strcmp(load_name, "copy")) load = LOAD_COPY;
+  else { printf("unknown background load %s\n", load_name); exit(1); }
+  if (bth <= 0) { printf("background threads must be > 0\n"); exit(1); }
+  if (log2_len < 0) { printf("log2 background array size must be >= 0\n"); exit(1); }
+  if (sweep && (concurrent || load != LOAD_NONE)) { printf("-w can't be combined with -c or -l\n"); exit(1); }
+  char *loaded = malloc(NODELETS());
+  long num_loaded = 0;
+  for (long i = 0; i < NODELETS(); ++i) loaded[i] = (load_list == NULL);
+  for (const char *p = load_list; p != NULL && *p; ) {
+    long nlet = strtol(p, (char **)&p, 10);
+    if (nlet < 0 || nlet >= NODELETS()) { printf("loaded nodelet %ld out of range\n", nlet); exit(1); }
+    loaded[nlet] = 1;
+    if (*p == ',') ++p;
+    else if (*p) { printf("invalid nodelet list %s\n", load_list); exit(1); }
+  }
+  for (long i = 0; i < NODELETS(); ++i) num_loaded += loaded[i];
+#ifndef __le64__
+  // native spawns don't create threads: each spinning background thread holds a Cilk worker,
+  // and the trials (and the code that stops the background threads) need at least one more
+  if (load != LOAD_NONE && bth * num_loaded >= __cilkrts_get_nworkers()) {
+    printf("%ld background threads need at least %ld Cilk workers, have %d (set CILK_NWORKERS)\n",
+	   bth * num_loaded, bth * num_loaded + 1, __cilkrts_get_nworkers());
+    exit(1);
+  }
+#endif
 
   // log variables for the run
   long n = 1L << log2_num;
@@ -124,8 +393,17 @@ int main(int argc, char** argv)
   printf("ping pong: src nlet %ld\n", src);
   printf("ping pong: dst nlet %ld\n", dst);
   printf("ping pong: num migrations %ld\n", n);
-  printf("ping pong: num threads %ld\n", nth);
+  if (sweep) printf("ping pong: sweep threads 1 to %ld\n", sweep);
+  else printf("ping pong: num threads %ld\n", nth);
   printf("ping pong: num trials %ld\n", ntr);
+  printf("ping pong: concurrent %ld\n", concurrent);
+  printf("ping pong: clock MHz %f\n", clock_mhz);
+  printf("ping pong: background load %s\n", load_name);
+  if (load != LOAD_NONE) {
+    printf("ping pong: background threads per nodelet %ld\n", bth);
+    printf("ping pong: background nodelets %ld\n", num_loaded);
+    printf("ping pong: background array elements %ld\n", 1L << log2_len);
+  }
   fflush(stdout);
 
   // replicated variables so no migrations for loop bounds
@@ -138,19 +416,38 @@ int main(int argc, char** argv)
     for (long j = 0; j < NODELETS(); ++j)
       results[i][j] = 0; // initialize results to zero
 
-#define RUN_BENCHMARK(X) for (long r = 0; r < ntr; ++r) X(src, dst)
+  if (sweep) {
+    starttiming();
+    ping_pong_sweep(src, dst, sweep, ntr, clock_mhz, thread_file);
+    free(loaded);
+    return 0;
+  }
 
-  // 3 modes for benchmark depending on src/dst arguments
   MIGRATE(results[0]);
   starttiming();
-  if ((src < 0) && (dst < 0)) RUN_BENCHMARK(ping_pong_spawn_all);
-  else if ((src < 0) || (dst < 0)) RUN_BENCHMARK(ping_pong_spawn_dist);
-  else RUN_BENCHMARK(ping_pong_spawn_nlet);
+  run_trials(src, dst, ntr, concurrent);
   MIGRATE(results[0]);
 
+  // run again under load, keeping the idle results as a baseline
+  long *baseline = NULL;
+  double offered_mbps = 0;
+  if (load != LOAD_NONE) {
+    baseline = malloc(NODELETS() * NODELETS() * sizeof(long));
+    for (long i = 0; i < NODELETS(); ++i)
+      for (long j = 0; j < NODELETS(); ++j) {
+	baseline[i * NODELETS() + j] = results[i][j];
+	results[i][j] = 0;
+      }
+    offered_mbps = run_loaded(src, dst, ntr, concurrent, load, loaded, bth, 1L << log2_len, clock_mhz);
+  }
+
   // gather and print results
 #ifndef DEBUG
-  gather(ntr);
+  gather(ntr, clock_mhz);
+  if (baseline != NULL) print_inflation(baseline, ntr, clock_mhz, offered_mbps, num_loaded);
+  if (matrix_file != NULL) write_matrix(matrix_file, ntr, clock_mhz);
 #endif
+  free(baseline);
+  free(loaded);
   return 0;
 }
@@ -1,3 +1,5 @@
+// posix_madvise is not declared in strict C11 mode
+#define _POSIX_C_SOURCE 200112L
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -7,39 +9,114 @@
 #include <string.h>
 #include <getopt.h>
 #include <limits.h>
+#include <errno.h>
 #include <emu_c_utils/emu_c_utils.h>
+#ifndef __le64__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "common.h"
-
+#include "benchmark_driver.h"
+#include "native_numa.h"
+#include "latency_histogram.h"
+#include "recursive_spawn.h"
+#include "index_generator.h"
+
+/*
+ * Header of each list element. With --node_bytes > 16, each element has cold padding after the payload.
+ * In the SoA layout, the hot pool is a striped array that only holds the links (8 bytes per element),
+ * and the payload of element i is element i of the cold pool.
+ */
 typedef struct node {
     struct node * next;
-    long weight;
+    // layout=aos: payload, layout=soa: not allocated
+    long weight[];
 } node;
 
+// Smallest --node_bytes: the next pointer and the payload
+#define NODE_MIN_BYTES ((long)sizeof(node) + (long)sizeof(long))
+
+enum node_layout {
+    AOS,
+    SOA
+};
+
+// What a thread does when the next node is on another nodelet
+enum chase_mode {
+    // Migrate to the node's nodelet and continue from there
+    MIGRATE_ALWAYS,
+    // Read the node and return to the home nodelet
+    REMOTE_READ,
+    // Return to the home nodelet, unless the last hybrid_threshold hops were all remote
+    HYBRID
+};
+
+// Payload of a node, the layout argument is loop-invariant in all callers
+// In the SoA layout, P - HOT is the element index (HOT is element 0 of the hot pool, COLD the cold pool)
+#define NODE_WEIGHT(P, LAYOUT, HOT, COLD) ((LAYOUT) == SOA ? (COLD)[(P) - (HOT)] : (P)->weight[0])
+
 enum sort_mode {
     ORDERED,
     INTRA_BLOCK_SHUFFLE,
     BLOCK_SHUFFLE,
-    FULL_BLOCK_SHUFFLE
+    FULL_BLOCK_SHUFFLE,
+    // Weighted random order, drawn from data->generator
+    SKEWED
 } sort_mode;
 
 typedef struct pointer_chase_data {
     long n;
     long block_size;
     long num_threads;
+    // Size of each list element, including padding
+    long node_bytes;
+    // Where the payload lives (AOS: inline, SOA: in cold_pool)
+    enum node_layout layout;
+    // How threads handle remote nodes, one of the chase_mode values
+    long chase_mode;
+    // Hybrid mode: move home after this many consecutive remote hops
+    long hybrid_threshold;
+    // Number of independent lists each thread traverses at the same time
+    long lists_per_thread;
+    // Prefetch the next node of each list (native only)
+    long prefetch;
     // Threads accumulate result into this field, to prevent over-optimization
     long sum;
     enum sort_mode sort_mode;
-    // One pointer per thread
+    // Seed for the random number generator used to shuffle the list
+    long seed;
+    // Skewed sort mode: likely elements (according to this distribution) come first in the list
+    index_generator generator;
+    // One pointer per list, the lists of thread i are heads[i + j * num_threads]
     node ** heads;
+    // Native builds with NUMA: node that holds the head of each thread's first list, looked up at init
+    long * numa_nodes;
     // Actual array pointer
     node ** pool;
+    // If layout == SOA: payload and padding of each node, one striped array per field (the payload is field 0)
+    long * cold_pool;
     // Ordering of linked list nodes
     long * indices;
+    // Latency mode: sample the clock every this many hops (0 to disable)
+    long latency_sample_interval;
+    // Latency mode: histogram of per-hop latency, each thread adds its samples to the copy on its current nodelet
+    long latency_histogram[LATENCY_HISTOGRAM_BUCKETS];
+    // Latency mode: number of hops that ended on a different nodelet
+    // Remote read and hybrid modes: number of hops to a node that was not on the home nodelet
+    long num_migrations;
+    // Hybrid mode: number of times a thread moved its home nodelet
+    long num_rehomes;
 } pointer_chase_data;
 
 replicated pointer_chase_data data;
 
+// Upper limit for --lists_per_thread, each thread keeps a cursor for every list in a scalar local
+// (an array would live in stack memory, and on Emu every access would migrate back to it)
+#define MAX_LISTS_PER_THREAD 8
+
 #define LCG_MUL64 6364136223846793005ULL
 #define LCG_ADD64 1
 
@@ -73,10 +150,10 @@ lcg_rand(unsigned long * x) {
    Only effective if N is much smaller than RAND_MAX;
    if this may not be the case, use a better random
    number generator. */
-void shuffle(long *array, size_t n)
+void shuffle(long *array, size_t n, unsigned long step)
 {
     unsigned long rand_state;
-    lcg_init(&rand_state, (unsigned long)array);
+    lcg_init(&rand_state, step);
     if (n > 1)
     {
         size_t i;
@@ -90,6 +167,15 @@ void shuffle(long *array, size_t n)
     }
 }
 
+// Position in the random number sequence to start shuffling from.
+// Each seed gets its own range of 2^32 numbers, so layouts are reproducible from run to run.
+// Shuffling N elements uses up to 2N numbers (see parallel_shuffle).
+static inline unsigned long
+shuffle_step(long seed, long offset)
+{
+    return ((unsigned long)seed << 32) + (unsigned long)offset;
+}
+
 // Initializes a list with 0, 1, 2, ...
 noinline void
 index_init_worker(long begin, long end, va_list args)
@@ -115,9 +201,37 @@ strided_index_init_worker(long begin, long end, va_list args)
     }
 }
 
+// Size of each element in the pool that holds the next pointers
+static inline long
+pool_element_bytes(pointer_chase_data* data) {
+    return data->layout == SOA ? (long)sizeof(node) : data->node_bytes;
+}
+
+// Number of fields of each element in the cold pool (SoA only): the payload and the padding
+static inline long
+cold_pool_num_fields(pointer_chase_data* data) {
+    return (data->node_bytes - (long)sizeof(node)) / (long)sizeof(long);
+}
+
 static inline node *
 get_node_ptr(pointer_chase_data* data, long i) {
-    return mw_arrayindex((long*)data->pool, (size_t)i, (size_t)data->n, sizeof(node));
+    // The SoA hot pool is a striped array of links, so element i is on the same nodelet as in mw_malloc2d
+    if (data->layout == SOA) { return (node*)data->pool + i; }
+    return mw_arrayindex((long*)data->pool, (size_t)i, (size_t)data->n, pool_element_bytes(data));
+}
+
+// Payload of element i (SoA only)
+static inline long *
+get_cold_ptr(pointer_chase_data* data, long i) {
+    return data->cold_pool + i;
+}
+
+// Number of bytes read from memory for each node visited
+static inline long
+bytes_per_node(pointer_chase_data* data) {
+    // next + weight, in either layout
+    (void)data;
+    return 2 * sizeof(long);
 }
 
 static void
@@ -136,7 +250,11 @@ relink_worker_1d(long * array, long begin, long end, va_list args)
 
         node_a->next = node_b;
         // Initialize payload
-        node_a->weight = i;
+        if (data->layout == SOA) {
+            *get_cold_ptr(data, a) = i;
+        } else {
+            node_a->weight[0] = i;
+        }
     }
 }
 
@@ -160,6 +278,130 @@ memcpy_long_worker(long begin, long end, ...)
 }
 
 
+/*
+ * Parallel shuffle (scatter, then shuffle each bucket), from Sanders, "Random Permutations on
+ * Distributed, External and Hierarchical Memory" (1998):
+ * 1. Each chunk of the array sends each of its elements to a random bucket
+ * 2. A prefix sum over the (bucket, chunk) counts gives each chunk a place to write in each bucket
+ * 3. Each chunk scatters its elements to the buckets
+ * 4. Each bucket is shuffled independently with Fisher-Yates
+ * Every chunk and bucket uses its own part of the random number sequence (lcg_init jumps ahead),
+ * and the number of chunks only depends on n, so the result does not depend on the number of threads.
+ */
+#define PARALLEL_SHUFFLE_LOG2_BUCKETS 8
+#define PARALLEL_SHUFFLE_BUCKETS (1L << PARALLEL_SHUFFLE_LOG2_BUCKETS)
+// Smaller arrays are shuffled serially
+#define PARALLEL_SHUFFLE_MIN_SIZE (1L << 16)
+
+static inline long
+parallel_shuffle_bucket(unsigned long * rand_state)
+{
+    // The high bits of the LCG are the most random
+    return lcg_rand(rand_state) >> (64 - PARALLEL_SHUFFLE_LOG2_BUCKETS);
+}
+
+static noinline void
+parallel_shuffle_count_worker(long begin, long end, va_list args)
+{
+    long n = va_arg(args, long);
+    unsigned long step = va_arg(args, unsigned long);
+    long * counts = va_arg(args, long*);
+    long chunk_size = n / PARALLEL_SHUFFLE_BUCKETS;
+    for (long chunk = begin; chunk < end; ++chunk) {
+        long * chunk_counts = counts + chunk * PARALLEL_SHUFFLE_BUCKETS;
+        unsigned long rand_state;
+        lcg_init(&rand_state, step + chunk * chunk_size);
+        for (long i = 0; i < chunk_size; ++i) {
+            chunk_counts[parallel_shuffle_bucket(&rand_state)] += 1;
+        }
+    }
+}
+
+static noinline void
+parallel_shuffle_scatter_worker(long begin, long end, va_list args)
+{
+    long n = va_arg(args, long);
+    unsigned long step = va_arg(args, unsigned long);
+    long * offsets = va_arg(args, long*);
+    long * src = va_arg(args, long*);
+    long * dst = va_arg(args, long*);
+    long chunk_size = n / PARALLEL_SHUFFLE_BUCKETS;
+    for (long chunk = begin; chunk < end; ++chunk) {
+        long * chunk_offsets = offsets + chunk * PARALLEL_SHUFFLE_BUCKETS;
+        unsigned long rand_state;
+        // Same sequence as the count pass, so each element goes to the same bucket
+        lcg_init(&rand_state, step + chunk * chunk_size);
+        for (long i = chunk * chunk_size; i < (chunk + 1) * chunk_size; ++i) {
+            dst[chunk_offsets[parallel_shuffle_bucket(&rand_state)]++] = src[i];
+        }
+    }
+}
+
+static noinline void
+parallel_shuffle_bucket_worker(long begin, long end, va_list args)
+{
+    long n = va_arg(args, long);
+    unsigned long step = va_arg(args, unsigned long);
+    long * bucket_offsets = va_arg(args, long*);
+    long * array = va_arg(args, long*);
+    for (long bucket = begin; bucket < end; ++bucket) {
+        long bucket_begin = bucket_offsets[bucket];
+        long bucket_end = bucket_offsets[bucket + 1];
+        shuffle(array + bucket_begin, bucket_end - bucket_begin, step + n + bucket_begin);
+    }
+}
+
+// Arrange the N elements of ARRAY in random order, in parallel.
+// Uses up to 2N numbers of the random sequence, starting at STEP.
+void
+parallel_shuffle(long * array, long n, unsigned long step)
+{
+    if (n < PARALLEL_SHUFFLE_MIN_SIZE || n % PARALLEL_SHUFFLE_BUCKETS != 0) {
+        shuffle(array, n, step);
+        return;
+    }
+    const long num_chunks = PARALLEL_SHUFFLE_BUCKETS;
+    const long num_buckets = PARALLEL_SHUFFLE_BUCKETS;
+
+    // counts[chunk][bucket] = number of elements from this chunk that go to this bucket
+    long * counts = mw_localmalloc(sizeof(long) * num_chunks * num_buckets, array);
+    runtime_assert(counts != NULL, "Failed to allocate bucket counts for shuffle");
+    memset(counts, 0, sizeof(long) * num_chunks * num_buckets);
+    emu_local_for(0, num_chunks, 1,
+        parallel_shuffle_count_worker, n, step, counts
+    );
+
+    // Exclusive prefix sum in bucket-major order, so each bucket is contiguous
+    long * bucket_offsets = mw_localmalloc(sizeof(long) * (num_buckets + 1), array);
+    runtime_assert(bucket_offsets != NULL, "Failed to allocate bucket offsets for shuffle");
+    long total = 0;
+    for (long bucket = 0; bucket < num_buckets; ++bucket) {
+        bucket_offsets[bucket] = total;
+        for (long chunk = 0; chunk < num_chunks; ++chunk) {
+            long count = counts[chunk * num_buckets + bucket];
+            counts[chunk * num_buckets + bucket] = total;
+            total += count;
+        }
+    }
+    bucket_offsets[num_buckets] = total;
+
+    long * tmp = mw_localmalloc(sizeof(long) * n, array);
+    runtime_assert(tmp != NULL, "Failed to allocate temporary array for shuffle");
+    emu_local_for(0, num_chunks, 1,
+        parallel_shuffle_scatter_worker, n, step, counts, array, tmp
+    );
+    emu_local_for(0, num_buckets, 1,
+        parallel_shuffle_bucket_worker, n, step, bucket_offsets, tmp
+    );
+    emu_local_for(0, n, LOCAL_GRAIN(n),
+        memcpy_long_worker_var, array, tmp
+    );
+
+    mw_localfree(tmp);
+    mw_localfree(bucket_offsets);
+    mw_localfree(counts);
+}
+
 // Shuffles the index array at a block level
 noinline void
 block_shuffle_worker(long begin, long end, va_list args)
@@ -189,35 +431,49 @@ intra_block_shuffle_worker(long begin, long end, va_list args)
     pointer_chase_data* data = va_arg(args, pointer_chase_data *);
     long block_size = va_arg(args, long);
     for (long block_id = begin; block_id < end; ++block_id) {
-        shuffle(data->indices + block_id * block_size, block_size);
+        // Each block draws from a separate part of the sequence, so the result does not depend on scheduling
+        parallel_shuffle(data->indices + block_id * block_size, block_size,
+            shuffle_step(data->seed, 2 * block_id * block_size));
     }
 }
 
-void
-pointer_chase_data_init(pointer_chase_data * data, long n, long block_size, long num_threads, enum sort_mode sort_mode)
+static noinline void
+gather_long_worker(long begin, long end, va_list args)
 {
-    data->n = n;
-    data->block_size = block_size;
-    data->num_threads = num_threads;
-    data->sort_mode = sort_mode;
-    mw_replicated_init(&data->sum, 0);
-    // Allocate N nodes, striped across nodelets
-    data->pool = mw_malloc2d(n, sizeof(node));
-    runtime_assert(data->pool != NULL, "Failed to allocate element pool");
-    // Store a pointer for this thread's head of the list
-    data->heads = (node**)mw_malloc1dlong(num_threads);
-    runtime_assert(data->heads != NULL, "Failed to allocate pointers for each thread");
-    // Make an array with entries 1 through n
-    data->indices = mw_mallocrepl(n * sizeof(long));
-    runtime_assert(data->indices != NULL, "Failed to allocate local index array");
-
-    LOG("Replicating pointers...\n");
-    // Replicate pointers to all other nodelets
-    pointer_chase_data * data0 = mw_get_nth(data, 0);
-    for (long i = 1; i < NODELETS(); ++i) {
-        pointer_chase_data * remote_data = mw_get_nth(data, i);
-        memcpy(remote_data, data0, sizeof(pointer_chase_data));
+    long * dst = va_arg(args, long*);
+    long * src = va_arg(args, long*);
+    long * order = va_arg(args, long*);
+    for (long i = begin; i < end; ++i) {
+        dst[i] = src[order[i]];
     }
+}
+
+// Reorders the (strided) index array so that likely elements come first, see index_generator_permutation
+static void
+pointer_chase_skew_indices(pointer_chase_data * data)
+{
+    long n = data->n;
+    LOG("Beginning skewed shuffle...\n");
+    long * order = mw_localmalloc(sizeof(long) * n, data);
+    long * old_indices = mw_localmalloc(sizeof(long) * n, data);
+    runtime_assert(order != NULL && old_indices != NULL, "Failed to allocate arrays for skewed shuffle");
+    index_generator_permutation(&data->generator, order);
+    emu_local_for(0, n, LOCAL_GRAIN(n),
+        memcpy_long_worker_var, old_indices, data->indices
+    );
+    emu_local_for(0, n, LOCAL_GRAIN(n),
+        gather_long_worker, data->indices, old_indices, order
+    );
+    mw_localfree(old_indices);
+    mw_localfree(order);
+}
+
+// Fills in data->indices on nodelet 0 with the order in which nodes will be linked together
+static void
+pointer_chase_generate_indices(pointer_chase_data * data)
+{
+    long n = data->n;
+    long block_size = data->block_size;
 
     // Initialize with striped index pattern (i.e. 0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15)
     // This will transform malloc2D address mode to sequential
@@ -244,10 +500,11 @@ pointer_chase_data_init(pointer_chase_data * data, long n, long block_size, long
             do_block_shuffle = true;
             do_intra_block_shuffle = true;
             break;
+        case SKEWED:
+            pointer_chase_skew_indices(data);
+            return;
     }
 
-
-    runtime_assert((n % block_size) == 0, "Block size must evenly divide number of elements");
     long num_blocks = n / block_size;
 
     if (do_block_shuffle) {
@@ -262,7 +519,7 @@ pointer_chase_data_init(pointer_chase_data * data, long n, long block_size, long
 
         LOG("shuffle block_indices...\n");
         // Randomly shuffle it
-        shuffle(block_indices, num_blocks);
+        parallel_shuffle(block_indices, num_blocks, shuffle_step(data->seed, 2 * n));
 
         LOG("copy old_indices...\n");
         // Make a copy of the indices array
@@ -288,6 +545,207 @@ pointer_chase_data_init(pointer_chase_data * data, long n, long block_size, long
             intra_block_shuffle_worker, data, (void*)block_size
         );
     }
+}
+
+/*
+ * Generating the index array is serial over large parts of the list, and dominates startup time
+ * (especially in the simulator). Since the layout only depends on a few parameters, it can be
+ * saved to a file and loaded by later runs that use the same parameters.
+ */
+#define INDEX_CACHE_MAGIC 0x78656469636864LL
+
+typedef struct index_cache_header {
+    long magic;
+    long n;
+    long block_size;
+    long sort_mode;
+    long seed;
+    long num_nodelets;
+    // Hash of the distribution parameters, for the skewed sort mode
+    long fingerprint;
+} index_cache_header;
+
+static void
+index_cache_filename(pointer_chase_data * data, const char * cache_dir, char * filename, size_t size)
+{
+    snprintf(filename, size, "%s/pointer_chase.n%li.b%li.m%i.s%li.nlets%li.f%016lx.idx",
+        cache_dir, data->n, data->block_size, (int)data->sort_mode, data->seed, (long)NODELETS(),
+        (unsigned long)index_generator_fingerprint(&data->generator));
+}
+
+static index_cache_header
+index_cache_header_for(pointer_chase_data * data)
+{
+    index_cache_header header;
+    header.magic = INDEX_CACHE_MAGIC;
+    header.n = data->n;
+    header.block_size = data->block_size;
+    header.sort_mode = data->sort_mode;
+    header.seed = data->seed;
+    header.num_nodelets = NODELETS();
+    header.fingerprint = index_generator_fingerprint(&data->generator);
+    return header;
+}
+
+// Returns true if the index array was loaded from the cache
+static bool
+pointer_chase_load_indices(pointer_chase_data * data, const char * cache_dir)
+{
+    char filename[4096];
+    index_cache_filename(data, cache_dir, filename, sizeof(filename));
+    index_cache_header expected = index_cache_header_for(data);
+    size_t bytes = sizeof(index_cache_header) + data->n * sizeof(long);
+
+#ifndef __le64__
+    // Map the file and copy out the indices in parallel
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != bytes) {
+        close(fd);
+        LOG("Ignoring index cache %s, wrong size\n", filename);
+        return false;
+    }
+    void * map = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { return false; }
+    posix_madvise(map, bytes, POSIX_MADV_SEQUENTIAL);
+    if (memcmp(map, &expected, sizeof(expected))) {
+        munmap(map, bytes);
+        LOG("Ignoring index cache %s, header does not match\n", filename);
+        return false;
+    }
+    long * cached = (long*)((char*)map + sizeof(index_cache_header));
+    emu_local_for(0, data->n, LOCAL_GRAIN(data->n),
+        memcpy_long_worker_var, data->indices, cached
+    );
+    munmap(map, bytes);
+    return true;
+#else
+    // No mmap on Emu, read the file straight into the index array
+    FILE * fp = fopen(filename, "rb");
+    if (fp == NULL) { return false; }
+    index_cache_header header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1
+        && !memcmp(&header, &expected, sizeof(header))
+        && fread(data->indices, sizeof(long), data->n, fp) == (size_t)data->n;
+    fclose(fp);
+    if (!ok) { LOG("Ignoring index cache %s, header or size does not match\n", filename); }
+    (void)bytes;
+    return ok;
+#endif
+}
+
+static void
+pointer_chase_save_indices(pointer_chase_data * data, const char * cache_dir)
+{
+    char filename[4096], tmp_filename[4096 + 32];
+    index_cache_filename(data, cache_dir, filename, sizeof(filename));
+    // Write to a temporary file and rename, so concurrent runs never see a partial file
+#ifndef __le64__
+    long pid = getpid();
+#else
+    long pid = 0;
+#endif
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp%li", filename, pid);
+    index_cache_header header = index_cache_header_for(data);
+
+    FILE * fp = fopen(tmp_filename, "wb");
+    if (fp == NULL) {
+        LOG("WARNING: could not create index cache %s: %s\n", tmp_filename, strerror(errno));
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(data->indices, sizeof(long), data->n, fp) == (size_t)data->n;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp_filename, filename) != 0) {
+        LOG("WARNING: could not write index cache %s: %s\n", filename, strerror(errno));
+        remove(tmp_filename);
+        return;
+    }
+    LOG("Saved index array to %s\n", filename);
+}
+
+// On native builds, place each nodelet's share of a contiguous pool on that nodelet's NUMA node before first touch.
+// Pages can't follow the element-by-element striping, so each nodelet gets a contiguous block of elements,
+// and remote-spawned threads are pinned to the node that holds their first element (see chase_list_pinned).
+static void
+pointer_chase_place_pool(void * pool, long n, long element_bytes)
+{
+    for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+        long first = n * nlet / NODELETS();
+        long last = n * (nlet + 1) / NODELETS();
+        native_place_on_nodelet((char*)pool + first * element_bytes, (last - first) * element_bytes, nlet);
+    }
+}
+
+void
+pointer_chase_data_init(pointer_chase_data * data, long n, long block_size, long num_threads,
+    long lists_per_thread, long node_bytes, enum node_layout layout,
+    enum sort_mode sort_mode, long seed, const index_generator * generator, const char * cache_dir)
+{
+    data->n = n;
+    data->node_bytes = node_bytes;
+    data->layout = layout;
+    data->block_size = block_size;
+    data->num_threads = num_threads;
+    data->lists_per_thread = lists_per_thread;
+    data->sort_mode = sort_mode;
+    data->seed = seed;
+    data->generator = *generator;
+    runtime_assert((n % block_size) == 0, "Block size must evenly divide number of elements");
+    mw_replicated_init(&data->sum, 0);
+    // Allocate N nodes, striped across nodelets
+    // In the SoA layout, each node is just a link, so a striped array of longs holds them
+    data->pool = layout == SOA ? (node**)mw_malloc1dlong(n) : mw_malloc2d(n, pool_element_bytes(data));
+    runtime_assert(data->pool != NULL, "Failed to allocate element pool");
+    // On native builds, spread the pool across NUMA nodes before first touch
+    // This only applies if the elements were allocated contiguously
+    long pool_bytes = n * pool_element_bytes(data);
+    if ((char*)get_node_ptr(data, n - 1) - (char*)get_node_ptr(data, 0) == pool_bytes - pool_element_bytes(data)) {
+        pointer_chase_place_pool(get_node_ptr(data, 0), n, pool_element_bytes(data));
+    }
+    data->cold_pool = NULL;
+    if (layout == SOA) {
+        // Allocate the payload and padding in a separate pool, one striped array of N longs per field,
+        // so element i of every field is on the same nodelet as node i
+        data->cold_pool = mw_malloc1dlong(n * cold_pool_num_fields(data));
+        runtime_assert(data->cold_pool != NULL, "Failed to allocate payload pool");
+        for (long f = 0; f < cold_pool_num_fields(data); ++f) {
+            pointer_chase_place_pool(data->cold_pool + f * n, n, sizeof(long));
+        }
+    }
+    // Store a pointer for the head of each thread's lists
+    long num_lists = num_threads * lists_per_thread;
+    data->heads = (node**)mw_malloc1dlong(num_lists);
+    runtime_assert(data->heads != NULL, "Failed to allocate pointers for each thread");
+    data->numa_nodes = NULL;
+    if (native_numa_enabled()) {
+        data->numa_nodes = malloc(sizeof(long) * num_threads);
+        runtime_assert(data->numa_nodes != NULL, "Failed to allocate NUMA node for each thread");
+    }
+    // Make an array with entries 1 through n
+    data->indices = mw_mallocrepl(n * sizeof(long));
+    runtime_assert(data->indices != NULL, "Failed to allocate local index array");
+
+    LOG("Replicating pointers...\n");
+    // Replicate pointers to all other nodelets
+    pointer_chase_data * data0 = mw_get_nth(data, 0);
+    for (long i = 1; i < NODELETS(); ++i) {
+        pointer_chase_data * remote_data = mw_get_nth(data, i);
+        memcpy(remote_data, data0, sizeof(pointer_chase_data));
+    }
+
+    const char * status = "generated";
+    if (cache_dir == NULL || !pointer_chase_load_indices(data, cache_dir)) {
+        pointer_chase_generate_indices(data);
+        if (cache_dir != NULL) {
+            pointer_chase_save_indices(data, cache_dir);
+        }
+    } else {
+        status = "loaded from cache";
+    }
+    LOG("Index array was %s\n", status);
 
     LOG("Scattering index array...\n");
     // emu_replicated_array_init(data->indices, sizeof(long), n);
@@ -307,10 +765,10 @@ pointer_chase_data_init(pointer_chase_data * data, long n, long block_size, long
     );
 
     LOG("Chop\n");
-    // Chop up the list so there is one chunk per thread
-    long chunk_size = n/num_threads;
-    LOG("Each thread will traverse %li elements\n", chunk_size);
-    for (long i = 0; i < data->num_threads; ++i) {
+    // Chop up the list so there is one chunk per list, and lists_per_thread lists per thread
+    long chunk_size = n/num_lists;
+    LOG("Each thread will traverse %li lists of %li elements\n", lists_per_thread, chunk_size);
+    for (long i = 0; i < num_lists; ++i) {
         long first_index = i * chunk_size;
         long last_index = (i+1) * chunk_size - 1;
 
@@ -319,36 +777,179 @@ pointer_chase_data_init(pointer_chase_data * data, long n, long block_size, long
        //     data->indices[last_index]
        // );
 
-        // Store a pointer for this thread's head of the list
+        // Store a pointer for this list's head
         data->heads[i] = get_node_ptr(data, data->indices[first_index]);
         // Set this thread's tail to null so it knows where to stop
         get_node_ptr(data, data->indices[last_index])->next = NULL;
     }
+    // Look up where each thread starts once, so the timed region doesn't have to
+    if (data->numa_nodes) {
+        for (long i = 0; i < num_threads; ++i) {
+            data->numa_nodes[i] = native_numa_node_of(data->heads[i]);
+        }
+    }
 }
 
 void
 pointer_chase_data_deinit(pointer_chase_data * data)
 {
     mw_free(data->pool);
+    if (data->cold_pool) { mw_free(data->cold_pool); }
     mw_free(data->heads);
+    free(data->numa_nodes);
     free(data->indices);
 }
 
 static noinline void
-chase_pointers(node * head, long * sum)
+chase_pointers(node * head, enum node_layout layout, const node * hot, const long * cold, long * sum)
+{
+    long local_sum = 0;
+    for (node * p = head; p != NULL; p = p->next) {
+        local_sum += NODE_WEIGHT(p, layout, hot, cold);
+    }
+    REMOTE_ADD(sum, local_sum);
+}
+
+// Same as chase_pointers, but samples the clock every few hops to record per-hop latency
+static noinline void
+chase_pointers_sampled(node * head, pointer_chase_data * data)
 {
+    const long interval = data->latency_sample_interval;
+    const enum node_layout layout = data->layout;
+    const node * hot = get_node_ptr(data, 0);
+    const long * cold = data->cold_pool;
     long local_sum = 0;
+    long num_migrations = 0;
+    long hops = 0;
+    long nlet = NODE_ID();
+    unsigned long start = latency_clock();
     for (node * p = head; p != NULL; p = p->next) {
-        local_sum += p->weight;
+        local_sum += NODE_WEIGHT(p, layout, hot, cold);
+        // On Emu, loading the payload migrates the thread to the nodelet that owns it
+        long here = NODE_ID();
+        if (here != nlet) {
+            num_migrations += 1;
+            nlet = here;
+        }
+        if (++hops == interval) {
+            unsigned long now = latency_clock();
+            latency_histogram_record(data->latency_histogram, (now - start) / interval);
+            start = now;
+            hops = 0;
+        }
+    }
+    REMOTE_ADD(&data->sum, local_sum);
+    REMOTE_ADD(&data->num_migrations, num_migrations);
+}
+
+// Same as chase_pointers, but the thread returns to its home nodelet after visiting a remote node,
+// so each remote hop costs a round trip, like a remote load.
+// With a hybrid_threshold, the thread moves its home after that many remote hops in a row.
+static noinline void
+chase_pointers_home(node * head, pointer_chase_data * data)
+{
+    const long threshold = data->chase_mode == HYBRID ? data->hybrid_threshold : 0;
+    const enum node_layout layout = data->layout;
+    const node * hot = get_node_ptr(data, 0);
+    const long * cold = data->cold_pool;
+    long home_nlet = NODE_ID();
+    long * home = mw_get_nth(&data->sum, home_nlet);
+    long local_sum = 0;
+    long num_remote = 0;
+    long num_rehomes = 0;
+    long consecutive_remote = 0;
+    for (node * p = head; p != NULL; ) {
+        // On Emu, loading the payload migrates the thread to the nodelet that owns it
+        local_sum += NODE_WEIGHT(p, layout, hot, cold);
+        node * next = p->next;
+        if (NODE_ID() == home_nlet) {
+            consecutive_remote = 0;
+        } else {
+            num_remote += 1;
+            if (threshold > 0 && ++consecutive_remote >= threshold) {
+                // The list has moved away from home, follow it
+                home_nlet = NODE_ID();
+                home = mw_get_nth(&data->sum, home_nlet);
+                consecutive_remote = 0;
+                num_rehomes += 1;
+            } else {
+                MIGRATE(home);
+            }
+        }
+        p = next;
+    }
+    REMOTE_ADD(&data->sum, local_sum);
+    REMOTE_ADD(&data->num_migrations, num_remote);
+    REMOTE_ADD(&data->num_rehomes, num_rehomes);
+}
+
+// Take one step in the list at cursor C (one of c0..c7 in chase_pointers_interleaved)
+#ifndef __le64__
+// Start loading the next node now, it will be needed after a step in each of the other lists
+#define CHASE_PREFETCH(C) do { if (prefetch) { __builtin_prefetch(C); } } while (0)
+#else
+#define CHASE_PREFETCH(C) do { } while (0)
+#endif
+#define CHASE_STEP(C) do { \
+    if (C != NULL) { \
+        local_sum += NODE_WEIGHT(C, layout, hot, cold); \
+        C = C->next; \
+        CHASE_PREFETCH(C); \
+        num_active += 1; \
+    } } while (0)
+
+// Traverse several lists at once, taking one step in each list in turn.
+// Misses in different lists are independent, so they can overlap (memory-level parallelism).
+// The cursors are scalar locals, so they travel with the thread context when it migrates.
+static noinline void
+chase_pointers_interleaved(node ** heads, long stride, long num_lists, enum node_layout layout,
+    const node * hot, const long * cold, bool prefetch, long * sum)
+{
+    (void)prefetch;
+#define LIST_HEAD(J) ((J) < num_lists ? heads[(J) * stride] : NULL)
+    node * c0 = LIST_HEAD(0), * c1 = LIST_HEAD(1), * c2 = LIST_HEAD(2), * c3 = LIST_HEAD(3);
+    node * c4 = LIST_HEAD(4), * c5 = LIST_HEAD(5), * c6 = LIST_HEAD(6), * c7 = LIST_HEAD(7);
+#undef LIST_HEAD
+    long local_sum = 0;
+    long num_active = num_lists;
+    while (num_active > 0) {
+        num_active = 0;
+        CHASE_STEP(c0); CHASE_STEP(c1); CHASE_STEP(c2); CHASE_STEP(c3);
+        CHASE_STEP(c4); CHASE_STEP(c5); CHASE_STEP(c6); CHASE_STEP(c7);
     }
     REMOTE_ADD(sum, local_sum);
 }
 
+// Traverse one thread's portion of the list
+static void
+chase_list(pointer_chase_data * data, long thread_id)
+{
+    if (data->chase_mode != MIGRATE_ALWAYS) {
+        chase_pointers_home(data->heads[thread_id], data);
+    } else if (data->lists_per_thread > 1 || data->prefetch) {
+        chase_pointers_interleaved(&data->heads[thread_id], data->num_threads,
+            data->lists_per_thread, data->layout, get_node_ptr(data, 0), data->cold_pool, data->prefetch, &data->sum);
+    } else if (data->latency_sample_interval > 0) {
+        chase_pointers_sampled(data->heads[thread_id], data);
+    } else {
+        chase_pointers(data->heads[thread_id], data->layout, get_node_ptr(data, 0), data->cold_pool, &data->sum);
+    }
+}
+
+// Native builds: run chase_list on the NUMA node that holds the thread's first element (native cilk_spawn_at)
+static void
+chase_list_pinned(pointer_chase_data * data, long thread_id)
+{
+    native_affinity saved = native_pin_to_node(data->numa_nodes ? data->numa_nodes[thread_id] : -1);
+    chase_list(data, thread_id);
+    native_unpin(saved);
+}
+
 void
 pointer_chase_serial_spawn(pointer_chase_data * data)
 {
     for (long i = 0; i < data->num_threads; ++i) {
-        cilk_spawn chase_pointers(data->heads[i], &data->sum);
+        cilk_spawn chase_list(data, i);
     }
 }
 
@@ -358,7 +959,7 @@ serial_spawn_local(pointer_chase_data * data, long nodelet_id)
     // Spawn a thread for each list head located at this nodelet
     // Using striped indexing to avoid migrations
     for (long i = nodelet_id; i < data->num_threads; i += NODELETS()) {
-        cilk_spawn chase_pointers(data->heads[i], &data->sum);
+        cilk_spawn chase_list_pinned(data, i);
     }
 }
 
@@ -373,6 +974,63 @@ pointer_chase_serial_remote_spawn(pointer_chase_data * data)
     }
 }
 
+static void
+recursive_spawn_local_worker(long begin, long end, pointer_chase_data * data, long nodelet_id)
+{
+    for (long i = begin; i < end; ++i) {
+        chase_list_pinned(data, nodelet_id + i * NODELETS());
+    }
+}
+
+static void
+recursive_spawn_local(long begin, long end, long grain, pointer_chase_data * data, long nodelet_id)
+{
+    RECURSIVE_CILK_SPAWN(begin, end, grain, recursive_spawn_local, data, nodelet_id);
+}
+
+static void
+recursive_remote_spawn_level1(long low, long high, pointer_chase_data * data)
+{
+    for (;;) {
+        long count = high - low;
+        if (count == 1) break;
+        long mid = low + count / 2;
+        cilk_spawn_at(&data->heads[low]) recursive_remote_spawn_level1(low, mid, data);
+        low = mid;
+    }
+
+    /* Recursive base case: spawn a thread for each list head located at this nodelet */
+    long num_local_threads = (data->num_threads - low + NODELETS() - 1) / NODELETS();
+    recursive_spawn_local(0, num_local_threads, 1, data, low);
+}
+
+// recursive_remote_spawn - Recursively spawns a thread at each nodelet, then recursively spawns threads for the local list heads
+void
+pointer_chase_recursive_remote_spawn(pointer_chase_data * data)
+{
+    long num_nodelets = data->num_threads < NODELETS() ? data->num_threads : NODELETS();
+    recursive_remote_spawn_level1(0, num_nodelets, data);
+}
+
+static void
+library_worker(long * array, long begin, long end, va_list args)
+{
+    (void)array;
+    pointer_chase_data * data = va_arg(args, pointer_chase_data *);
+    for (long i = begin; i < end; i += NODELETS()) {
+        chase_list(data, i);
+    }
+}
+
+// library - Uses emu_1d_array_apply to spawn a thread for each list head
+void
+pointer_chase_library(pointer_chase_data * data)
+{
+    emu_1d_array_apply((long*)data->heads, data->num_threads, 1,
+        library_worker, data
+    );
+}
+
 // TODO make this an emu_c_utils library function
 long
 emu_replicated_reduce_sum_long(long * x)
@@ -390,12 +1048,17 @@ void pointer_chase_run(
     void (*benchmark)(pointer_chase_data *),
     long num_trials)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "chase_pointers", num_trials, data->n * bytes_per_node(data), "MB/s");
+    latency_histogram_clear_replicated(data->latency_histogram);
+    mw_replicated_init(&data->num_migrations, 0);
+    mw_replicated_init(&data->num_rehomes, 0);
+    native_pin_overhead_reset();
+    while (benchmark_driver_next(&driver)) {
         mw_replicated_init(&data->sum, 0);
-        hooks_region_begin("chase_pointers");
+        benchmark_driver_begin_trial(&driver);
         benchmark(data);
-        double time_ms = hooks_region_end();
+        benchmark_driver_end_trial(&driver);
 #ifndef NO_VALIDATE
         // Sum of all integers from 0 to n
         long expected_sum = (data->n * (data->n - 1)) / 2;
@@ -403,9 +1066,29 @@ void pointer_chase_run(
         LOG("expected_sum = %li, actual_sum = %li\n", expected_sum, actual_sum);
         runtime_assert(actual_sum == expected_sum, "Validation FAILED!");
 #endif
-        double bytes_per_second = time_ms == 0 ? 0 :
-            (data->n * sizeof(node)) / (time_ms/1000);
-        LOG("%3.2f MB/s\n", bytes_per_second / (1000000));
+    }
+    benchmark_driver_finish(&driver);
+    if (native_pin_overhead_ms() > 0) {
+        // Summed over all workers, so it can be more than the elapsed time
+        LOG("NUMA pinning took %3.3f ms of worker time per trial, included in the times above\n",
+            native_pin_overhead_ms() / driver.num_started);
+    }
+
+    if (data->latency_sample_interval > 0) {
+        long histogram[LATENCY_HISTOGRAM_BUCKETS];
+        latency_histogram_reduce_replicated(data->latency_histogram, histogram);
+        LOG("Per-hop latency, sampled every %li hops:\n", data->latency_sample_interval);
+        latency_histogram_print(histogram);
+        long num_hops = data->n * benchmark_driver_num_completed(&driver);
+        long num_migrations = emu_replicated_reduce_sum_long(&data->num_migrations);
+        LOG("%li of %li hops migrated (%3.2f%%), %li stayed local\n",
+            num_migrations, num_hops, 100.0 * num_migrations / num_hops, num_hops - num_migrations);
+    } else if (data->chase_mode != MIGRATE_ALWAYS) {
+        long num_hops = data->n * benchmark_driver_num_completed(&driver);
+        long num_remote = emu_replicated_reduce_sum_long(&data->num_migrations);
+        long num_rehomes = emu_replicated_reduce_sum_long(&data->num_rehomes);
+        LOG("%li of %li hops were remote (%3.2f%%), threads moved home %li times\n",
+            num_remote, num_hops, 100.0 * num_remote / num_hops, num_rehomes);
     }
 }
 
@@ -417,6 +1100,19 @@ static const struct option long_options[] = {
     {"spawn_mode"   , required_argument},
     {"sort_mode"    , required_argument},
     {"num_trials"   , required_argument},
+    {"latency_sample_interval", required_argument},
+    {"seed"         , required_argument},
+    {"lists_per_thread", required_argument},
+    {"node_bytes"   , required_argument},
+    {"chase_mode"   , required_argument},
+    {"hybrid_threshold", required_argument},
+    {"layout"       , required_argument},
+    {"prefetch"     , no_argument},
+    {"index_cache_dir", required_argument},
+    {"distribution" , required_argument},
+    {"alpha"        , required_argument},
+    {"rmat"         , required_argument},
+    {"replay_file"  , required_argument},
     {"help"         , no_argument},
     {NULL}
 };
@@ -431,6 +1127,19 @@ print_help(const char* argv0)
     LOG("\t--spawn_mode         How to spawn the threads\n");
     LOG("\t--sort_mode          How to shuffle the array\n");
     LOG("\t--num_trials         Number of times to repeat the benchmark\n");
+    LOG("\t--latency_sample_interval  Record a histogram of per-hop latency, sampling the clock every K hops\n");
+    LOG("\t--chase_mode         What to do at a remote node: migrate, remote_read, or hybrid\n");
+    LOG("\t--hybrid_threshold   In hybrid mode, move home after this many consecutive remote hops\n");
+    LOG("\t--node_bytes         Size of each list element in bytes (multiple of 8, at least 16)\n");
+    LOG("\t--layout             aos: payload inside each element, soa: payload in a separate pool\n");
+    LOG("\t--lists_per_thread   Number of lists each thread traverses at the same time\n");
+    LOG("\t--prefetch           Prefetch the next node in each list (native only)\n");
+    LOG("\t--seed               Seed for the random number generator used to shuffle the list\n");
+    LOG("\t--index_cache_dir    Save the shuffled list layout here, and load it on later runs with the same parameters\n");
+    LOG("\t--distribution       With sort_mode=skewed: uniform, zipf, rmat, or replay\n");
+    LOG("\t--alpha              Exponent of the zipf distribution (default 1.0)\n");
+    LOG("\t--rmat               RMAT parameters a,b,c (default 0.57,0.19,0.19)\n");
+    LOG("\t--replay_file        File of 64-bit element indices, for the replay distribution\n");
     LOG("\t--help               Print command line help\n");
 }
 
@@ -441,6 +1150,19 @@ typedef struct pointer_chase_args {
     const char* spawn_mode;
     const char* sort_mode;
     long num_trials;
+    long latency_sample_interval;
+    long seed;
+    const char* index_cache_dir;
+    long lists_per_thread;
+    bool prefetch;
+    long node_bytes;
+    const char* layout;
+    const char* chase_mode;
+    long hybrid_threshold;
+    const char* distribution;
+    double alpha;
+    const char* rmat;
+    const char* replay_file;
 } pointer_chase_args;
 
 static struct pointer_chase_args
@@ -453,6 +1175,19 @@ parse_args(int argc, char *argv[])
     args.spawn_mode = "serial_spawn";
     args.sort_mode = "block_shuffle";
     args.num_trials = 1;
+    args.latency_sample_interval = 0;
+    args.seed = 0;
+    args.lists_per_thread = 1;
+    args.node_bytes = NODE_MIN_BYTES;
+    args.layout = "aos";
+    args.chase_mode = "migrate";
+    args.hybrid_threshold = 4;
+    args.prefetch = false;
+    args.index_cache_dir = getenv("POINTER_CHASE_INDEX_CACHE_DIR");
+    args.distribution = "zipf";
+    args.alpha = 1.0;
+    args.rmat = NULL;
+    args.replay_file = NULL;
 
     int option_index;
     while (true)
@@ -480,6 +1215,32 @@ parse_args(int argc, char *argv[])
             args.sort_mode = optarg;
         } else if (!strcmp(option_name, "num_trials")) {
             args.num_trials = atol(optarg);
+        } else if (!strcmp(option_name, "latency_sample_interval")) {
+            args.latency_sample_interval = atol(optarg);
+        } else if (!strcmp(option_name, "node_bytes")) {
+            args.node_bytes = atol(optarg);
+        } else if (!strcmp(option_name, "layout")) {
+            args.layout = optarg;
+        } else if (!strcmp(option_name, "chase_mode")) {
+            args.chase_mode = optarg;
+        } else if (!strcmp(option_name, "hybrid_threshold")) {
+            args.hybrid_threshold = atol(optarg);
+        } else if (!strcmp(option_name, "lists_per_thread")) {
+            args.lists_per_thread = atol(optarg);
+        } else if (!strcmp(option_name, "prefetch")) {
+            args.prefetch = true;
+        } else if (!strcmp(option_name, "seed")) {
+            args.seed = atol(optarg);
+        } else if (!strcmp(option_name, "index_cache_dir")) {
+            args.index_cache_dir = optarg;
+        } else if (!strcmp(option_name, "distribution")) {
+            args.distribution = optarg;
+        } else if (!strcmp(option_name, "alpha")) {
+            args.alpha = atof(optarg);
+        } else if (!strcmp(option_name, "rmat")) {
+            args.rmat = optarg;
+        } else if (!strcmp(option_name, "replay_file")) {
+            args.replay_file = optarg;
         } else if (!strcmp(option_name, "help")) {
             print_help(argv[0]);
             exit(1);
@@ -488,6 +1249,25 @@ parse_args(int argc, char *argv[])
     if (args.log2_num_elements <= 0) { LOG( "log2_num_elements must be > 0"); exit(1); }
     if (args.block_size <= 0) { LOG( "block_size must be > 0"); exit(1); }
     if (args.num_threads <= 0) { LOG( "num_threads must be > 0"); exit(1); }
+    if (args.node_bytes < NODE_MIN_BYTES || args.node_bytes % sizeof(long) != 0) {
+        LOG( "node_bytes must be a multiple of 8 and at least %li\n", NODE_MIN_BYTES); exit(1);
+    }
+    if (args.lists_per_thread <= 0 || args.lists_per_thread > MAX_LISTS_PER_THREAD) {
+        LOG( "lists_per_thread must be between 1 and %i\n", MAX_LISTS_PER_THREAD); exit(1);
+    }
+    if (args.latency_sample_interval > 0 && (args.lists_per_thread > 1 || args.prefetch)) {
+        LOG( "latency_sample_interval cannot be combined with lists_per_thread or prefetch\n"); exit(1);
+    }
+    if (strcmp(args.chase_mode, "migrate") && (args.latency_sample_interval > 0 || args.lists_per_thread > 1 || args.prefetch)) {
+        LOG( "chase_mode %s cannot be combined with latency_sample_interval, lists_per_thread or prefetch\n", args.chase_mode); exit(1);
+    }
+    if (args.hybrid_threshold <= 0) { LOG( "hybrid_threshold must be > 0"); exit(1); }
+#ifdef __le64__
+    if (args.prefetch) { LOG( "prefetch is only supported in native builds\n"); exit(1); }
+#endif
+    if (args.seed < 0) { LOG( "seed must be >= 0"); exit(1); }
+    if (args.latency_sample_interval < 0) { LOG( "latency_sample_interval must be >= 0"); exit(1); }
+    if (args.alpha <= 0) { LOG( "alpha must be > 0"); exit(1); }
     return args;
 }
 
@@ -514,20 +1294,73 @@ int main(int argc, char** argv)
         sort_mode = INTRA_BLOCK_SHUFFLE;
     } else if (!strcmp(args.sort_mode, "full_block_shuffle")) {
         sort_mode = FULL_BLOCK_SHUFFLE;
+    } else if (!strcmp(args.sort_mode, "skewed")) {
+        sort_mode = SKEWED;
     } else {
         LOG( "Sort mode %s not implemented!\n", args.sort_mode);
         exit(1);
     }
 
+    enum node_layout layout;
+    if (!strcmp(args.layout, "aos")) {
+        layout = AOS;
+    } else if (!strcmp(args.layout, "soa")) {
+        layout = SOA;
+    } else {
+        LOG( "Layout %s not implemented!\n", args.layout);
+        exit(1);
+    }
+
+    enum chase_mode chase_mode;
+    if (!strcmp(args.chase_mode, "migrate")) {
+        chase_mode = MIGRATE_ALWAYS;
+    } else if (!strcmp(args.chase_mode, "remote_read")) {
+        chase_mode = REMOTE_READ;
+    } else if (!strcmp(args.chase_mode, "hybrid")) {
+        chase_mode = HYBRID;
+    } else {
+        LOG( "Chase mode %s not implemented!\n", args.chase_mode);
+        exit(1);
+    }
+
     hooks_set_attr_i64("log2_num_elements", args.log2_num_elements);
     hooks_set_attr_i64("num_threads", args.num_threads);
     hooks_set_attr_i64("block_size", args.block_size);
     hooks_set_attr_str("spawn_mode", args.spawn_mode);
     hooks_set_attr_str("sort_mode", args.sort_mode);
     hooks_set_attr_i64("num_nodelets", NODELETS());
+    hooks_set_attr_i64("latency_sample_interval", args.latency_sample_interval);
+    hooks_set_attr_i64("seed", args.seed);
+    hooks_set_attr_i64("lists_per_thread", args.lists_per_thread);
+    hooks_set_attr_i64("node_bytes", args.node_bytes);
+    hooks_set_attr_str("layout", args.layout);
+    hooks_set_attr_str("chase_mode", args.chase_mode);
+    hooks_set_attr_i64("hybrid_threshold", args.hybrid_threshold);
+    hooks_set_attr_i64("prefetch", args.prefetch);
 
     long n = 1L << args.log2_num_elements;
-    long bytes = n * (sizeof(node));
+
+    // The generator is only used by the skewed sort mode, and stays cyclic (no-op) otherwise
+    index_generator generator;
+    index_generator_init(&generator, INDEX_DIST_CYCLIC, n, args.seed);
+    if (sort_mode == SKEWED) {
+        long distribution;
+        if (!index_distribution_parse(args.distribution, &distribution)) {
+            LOG( "Distribution %s not implemented!\n", args.distribution);
+            exit(1);
+        }
+        index_generator_init(&generator, distribution, n, args.seed);
+        if (distribution == INDEX_DIST_ZIPF) {
+            index_generator_set_zipf(&generator, args.alpha);
+        } else if (distribution == INDEX_DIST_RMAT && args.rmat != NULL) {
+            index_generator_set_rmat(&generator, args.rmat);
+        } else if (distribution == INDEX_DIST_REPLAY) {
+            if (args.replay_file == NULL) { LOG( "replay distribution requires --replay_file\n"); exit(1); }
+            index_generator_load_replay(&generator, args.replay_file);
+        }
+        hooks_set_attr_str("distribution", args.distribution);
+    }
+    long bytes = n * args.node_bytes;
     long mbytes = bytes / (1000000);
     long mbytes_per_nodelet = mbytes / NODELETS();
     LOG("Initializing %s array with %li elements (%li MB total, %li MB per nodelet)\n",
@@ -535,8 +1368,13 @@ int main(int argc, char** argv)
 
     hooks_region_begin("init");
     pointer_chase_data_init(&data,
-        n, args.block_size, args.num_threads, sort_mode);
+        n, args.block_size, args.num_threads, args.lists_per_thread,
+        args.node_bytes, layout, sort_mode, args.seed, &generator, args.index_cache_dir);
     hooks_region_end();
+    mw_replicated_init(&data.latency_sample_interval, args.latency_sample_interval);
+    mw_replicated_init(&data.prefetch, args.prefetch);
+    mw_replicated_init(&data.chase_mode, chase_mode);
+    mw_replicated_init(&data.hybrid_threshold, args.hybrid_threshold);
     LOG( "Launching %s with %li threads...\n", args.spawn_mode, args.num_threads);
 
     #define RUN_BENCHMARK(X) pointer_chase_run(&data, args.spawn_mode, X, args.num_trials)
@@ -545,11 +1383,16 @@ int main(int argc, char** argv)
         RUN_BENCHMARK(pointer_chase_serial_spawn);
     } else if (!strcmp(args.spawn_mode, "serial_remote_spawn")) {
         RUN_BENCHMARK(pointer_chase_serial_remote_spawn);
+    } else if (!strcmp(args.spawn_mode, "recursive_remote_spawn")) {
+        RUN_BENCHMARK(pointer_chase_recursive_remote_spawn);
+    } else if (!strcmp(args.spawn_mode, "library")) {
+        RUN_BENCHMARK(pointer_chase_library);
     } else {
         LOG( "Spawn mode %s not implemented!", args.spawn_mode);
         exit(1);
     }
 
     pointer_chase_data_deinit(&data);
+    index_generator_deinit(&generator);
     return 0;
 }
@@ -8,11 +8,14 @@
 
 #include <emu_c_utils/emu_c_utils.h>
 #include "common.h"
+#include "benchmark_driver.h"
 
 typedef struct scatter_data {
     long * buffer;
     long n;
     long num_threads;
+    // pipelined_tree: number of elements forwarded at a time
+    long chunk_size;
 } scatter_data;
 
 replicated scatter_data data;
@@ -25,10 +28,11 @@ init_replicated_ptr(long ** loc, long * ptr)
 }
 
 void
-scatter_data_init(scatter_data * data, long n, long num_threads)
+scatter_data_init(scatter_data * data, long n, long num_threads, long chunk_size)
 {
     mw_replicated_init(&data->n, n);
     mw_replicated_init(&data->num_threads, num_threads);
+    mw_replicated_init(&data->chunk_size, chunk_size);
 
     // Allocate an array on nodelet 0, and replicate the pointer
     init_replicated_ptr(&data->buffer,
@@ -168,21 +172,109 @@ noinline void scatter_recursive_tree(scatter_data * data)
     scatter_tree(data->buffer, data->n, 0, NODELETS());
 }
 
+// Pipelined tree: nodelets form a binary tree in heap order (the children of k are 2k+1 and 2k+2),
+// so no nodelet sends a chunk more than twice
+static inline long
+scatter_pipeline_child(long nlet, long c)
+{
+    return 2 * nlet + 1 + c;
+}
+
+// Copy elements [begin, end) to a child nodelet, with the same parallel loop as scatter_tree
+static void
+scatter_pipeline_copy(long * buffer, long begin, long end, long from, long to)
+{
+    long * src = mw_get_nth(buffer, from);
+    long * dst = mw_get_nth(buffer, to);
+    emu_local_for(begin, end, LOCAL_GRAIN_MIN(end - begin, 64),
+        copy_long_worker_var, dst, src
+    );
+}
+
+// Runs on a nodelet that has received a chunk: pass it to each child and spawn there to forward it further
+static void
+scatter_pipeline_forward(long * buffer, long begin, long end, long nlet)
+{
+    for (long c = 0; c < 2; ++c) {
+        long child = scatter_pipeline_child(nlet, c);
+        if (child >= NODELETS()) { break; }
+        scatter_pipeline_copy(buffer, begin, end, nlet, child);
+        cilk_spawn_at(mw_get_nth(buffer, child)) scatter_pipeline_forward(buffer, begin, end, child);
+    }
+}
+
+// Broadcast down a binary tree one chunk at a time, so that chunk k is forwarded further down the tree
+// while nodelet 0 is still sending chunk k+1. Nodelet 0 only sends the array twice, instead of
+// log2(NODELETS()) times like scatter_tree.
+noinline void
+scatter_pipelined_tree(scatter_data * data)
+{
+    for (long begin = 0; begin < data->n; begin += data->chunk_size) {
+        long end = begin + data->chunk_size < data->n ? begin + data->chunk_size : data->n;
+        // Same as scatter_pipeline_forward(data->buffer, begin, end, 0), but without returning:
+        // a spawning function syncs before it returns, which would wait for each chunk to reach every nodelet
+        for (long c = 0; c < 2; ++c) {
+            long child = scatter_pipeline_child(0, c);
+            if (child >= NODELETS()) { break; }
+            scatter_pipeline_copy(data->buffer, begin, end, 0, child);
+            cilk_spawn_at(mw_get_nth(data->buffer, child)) scatter_pipeline_forward(data->buffer, begin, end, child);
+        }
+    }
+}
+
+static noinline void
+scatter_fill_nodelet(scatter_data * data, long nlet)
+{
+    long * buffer = mw_get_nth(data->buffer, nlet);
+    for (long i = 0; i < data->n; ++i) {
+        // Only nodelet 0 has the data, the others start out with values that can't match
+        buffer[i] = nlet == 0 ? i : -1;
+    }
+}
+
+// Reset every nodelet's copy before each trial
+noinline void
+scatter_fill(scatter_data * data)
+{
+    for (long nlet = 0; nlet < NODELETS(); ++nlet) {
+        cilk_spawn_at(mw_get_nth(data->buffer, nlet)) scatter_fill_nodelet(data, nlet);
+    }
+}
+
+// Check that every nodelet received the full buffer
+void
+scatter_validate(scatter_data * data)
+{
+    for (long nlet = 1; nlet < NODELETS(); ++nlet) {
+        long * buffer = mw_get_nth(data->buffer, nlet);
+        for (long i = 0; i < data->n; ++i) {
+            if (buffer[i] != i) {
+                LOG("Error in validation: nodelet %li element %li is %li, expected %li\n",
+                    nlet, i, buffer[i], i);
+                exit(1);
+            }
+        }
+    }
+}
 
 void scatter_run(
     scatter_data * data,
     void (*benchmark)(scatter_data *),
     long num_trials)
 {
-    for (long trial = 0; trial < num_trials; ++trial) {
-        hooks_set_attr_i64("trial", trial);
-        hooks_region_begin("scatter");
+    benchmark_driver driver;
+    benchmark_driver_init(&driver, "scatter", num_trials,
+        data->n * sizeof(long) * (NODELETS()-1), "MB/s");
+    while (benchmark_driver_next(&driver)) {
+        scatter_fill(data);
+        benchmark_driver_begin_trial(&driver);
         benchmark(data);
-        double time_ms = hooks_region_end();
-        double bytes_per_second = time_ms == 0 ? 0 :
-            (data->n * sizeof(long) * (NODELETS()-1)) / (time_ms/1000);
-        LOG("%3.2f MB/s\n", bytes_per_second / (1000000));
+        benchmark_driver_end_trial(&driver);
+#ifndef NO_VALIDATE
+        scatter_validate(data);
+#endif
     }
+    benchmark_driver_finish(&driver);
 }
 
 replicated scatter_data data;
@@ -194,32 +286,36 @@ int main(int argc, char** argv)
         long log2_num_elements;
         long num_threads;
         long num_trials;
+        long log2_chunk_size;
     } args;
 
-    if (argc != 5) {
-        LOG("Usage: %s mode log2_num_elements num_threads num_trials\n", argv[0]);
+    if (argc != 5 && argc != 6) {
+        LOG("Usage: %s mode log2_num_elements num_threads num_trials [log2_chunk_size]\n", argv[0]);
         exit(1);
     } else {
         args.mode = argv[1];
         args.log2_num_elements = atol(argv[2]);
         args.num_threads = atol(argv[3]);
         args.num_trials = atol(argv[4]);
+        args.log2_chunk_size = argc == 6 ? atol(argv[5]) : 10;
 
         if (args.log2_num_elements <= 0) { LOG("log2_num_elements must be > 0"); exit(1); }
         if (args.num_threads <= 0) { LOG("num_threads must be > 0"); exit(1); }
         if (args.num_trials <= 0) { LOG("num_trials must be > 0"); exit(1); }
+        if (args.log2_chunk_size < 0) { LOG("log2_chunk_size must be >= 0"); exit(1); }
     }
 
     hooks_set_attr_str("mode", args.mode);
     hooks_set_attr_i64("log2_num_elements", args.log2_num_elements);
     hooks_set_attr_i64("num_threads", args.num_threads);
+    hooks_set_attr_i64("log2_chunk_size", args.log2_chunk_size);
     hooks_set_attr_i64("num_nodelets", NODELETS());
     hooks_set_attr_i64("num_bytes_per_element", sizeof(long));
 
     long n = 1L << args.log2_num_elements;
     long mbytes = n * sizeof(long) / (1024*1024);
     LOG("Initializing arrays with %li elements each (%li MiB)\n", n, mbytes);
-    scatter_data_init(&data, n, args.num_threads);
+    scatter_data_init(&data, n, args.num_threads, 1L << args.log2_chunk_size);
     LOG("Scattering with %s\n", args.mode);
 
     #define RUN_BENCHMARK(X) scatter_run(&data, X, args.num_trials)
@@ -234,6 +330,8 @@ int main(int argc, char** argv)
         RUN_BENCHMARK(scatter_emu_for);
     } else if (!strcmp(args.mode, "tree")) {
         RUN_BENCHMARK(scatter_recursive_tree);
+    } else if (!strcmp(args.mode, "pipelined_tree")) {
+        RUN_BENCHMARK(scatter_pipelined_tree);
     } else {
         LOG("Spawn mode %s not implemented!", args.mode);
     }
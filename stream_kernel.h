@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "common.h"
+
+/*
+ * The four STREAM kernels, selected with --kernel in the stream benchmarks
+ *
+ * All kernels write to C, so that every spawn mode and validation work unchanged:
+ *     copy    C = A
+ *     scale   C = 3 * A
+ *     add     C = A + B
+ *     triad   C = A + 3 * B
+ *
+ * copy and scale only touch two arrays (one read, one write), add and triad touch three (two reads, one write).
+ */
+typedef enum stream_kernel {
+    STREAM_COPY,
+    STREAM_SCALE,
+    STREAM_ADD,
+    STREAM_TRIAD,
+} stream_kernel;
+
+// Scalar used by the scale and triad kernels
+#define STREAM_SCALAR 3
+
+static inline bool
+stream_kernel_parse(const char * name, long * kernel)
+{
+    if      (!strcmp(name, "copy"))  { *kernel = STREAM_COPY; }
+    else if (!strcmp(name, "scale")) { *kernel = STREAM_SCALE; }
+    else if (!strcmp(name, "add"))   { *kernel = STREAM_ADD; }
+    else if (!strcmp(name, "triad")) { *kernel = STREAM_TRIAD; }
+    else { return false; }
+    return true;
+}
+
+static inline const char *
+stream_kernel_name(long kernel)
+{
+    switch (kernel) {
+        case STREAM_COPY:  return "copy";
+        case STREAM_SCALE: return "scale";
+        case STREAM_ADD:   return "add";
+        case STREAM_TRIAD: return "triad";
+        default:           return "unknown";
+    }
+}
+
+// Number of bytes read and written for each element of the arrays
+static inline long
+stream_kernel_bytes_per_element(long kernel)
+{
+    return (kernel == STREAM_COPY || kernel == STREAM_SCALE ? 2 : 3) * sizeof(long);
+}
+
+// Value of each element of C after running the kernel, given that A is all 1's and B is all 2's
+static inline long
+stream_kernel_expected(long kernel)
+{
+    switch (kernel) {
+        case STREAM_COPY:  return 1;
+        case STREAM_SCALE: return STREAM_SCALAR * 1;
+        case STREAM_ADD:   return 1 + 2;
+        case STREAM_TRIAD: return 1 + STREAM_SCALAR * 2;
+        default:           return 0;
+    }
+}
+
+/*
+ * Computes one element of C. Only the operands used by the kernel are evaluated,
+ * so copy and scale never load from B. The kernel is loop-invariant in every caller,
+ * so the compiler hoists the switch out of the loop (loop unswitching).
+ */
+#define STREAM_KERNEL_APPLY(KERNEL, C, A, B)                            \
+do {                                                                    \
+    switch (KERNEL) {                                                   \
+        case STREAM_COPY:  (C) = (A); break;                            \
+        case STREAM_SCALE: (C) = STREAM_SCALAR * (A); break;            \
+        case STREAM_ADD:   (C) = (A) + (B); break;                      \
+        default:           (C) = (A) + STREAM_SCALAR * (B); break;      \
+    }                                                                   \
+} while (0)
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * Explicitly vectorized kernels for the stream benchmarks (native x86 builds only)
+ *
+ * Uses the widest integer vector extension enabled at compile time (AVX-512, AVX2, or SSE2).
+ * Build with -DCMAKE_C_FLAGS=-march=native to get AVX2/AVX-512 on hosts that support it.
+ */
+
+#if defined(__x86_64__) && !defined(__le64__)
+#define HAVE_STREAM_SIMD
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "stream_kernel.h"
+
+#if defined(__AVX512F__)
+#define STREAM_SIMD_WIDTH 8
+typedef __m512i stream_vec;
+#define STREAM_VEC_LOADU(P)     _mm512_loadu_si512((const void*)(P))
+#define STREAM_VEC_STOREU(P, V) _mm512_storeu_si512((void*)(P), V)
+#define STREAM_VEC_STREAM(P, V) _mm512_stream_si512((void*)(P), V)
+#define STREAM_VEC_ADD(X, Y)    _mm512_add_epi64(X, Y)
+#elif defined(__AVX2__)
+#define STREAM_SIMD_WIDTH 4
+typedef __m256i stream_vec;
+#define STREAM_VEC_LOADU(P)     _mm256_loadu_si256((const __m256i*)(P))
+#define STREAM_VEC_STOREU(P, V) _mm256_storeu_si256((__m256i*)(P), V)
+#define STREAM_VEC_STREAM(P, V) _mm256_stream_si256((__m256i*)(P), V)
+#define STREAM_VEC_ADD(X, Y)    _mm256_add_epi64(X, Y)
+#else
+#define STREAM_SIMD_WIDTH 2
+typedef __m128i stream_vec;
+#define STREAM_VEC_LOADU(P)     _mm_loadu_si128((const __m128i*)(P))
+#define STREAM_VEC_STOREU(P, V) _mm_storeu_si128((__m128i*)(P), V)
+#define STREAM_VEC_STREAM(P, V) _mm_stream_si128((__m128i*)(P), V)
+#define STREAM_VEC_ADD(X, Y)    _mm_add_epi64(X, Y)
+#endif
+
+// There is no 64-bit multiply before AVX-512DQ, so scale by STREAM_SCALAR (3) with adds
+#define STREAM_VEC_TIMES3(X)    STREAM_VEC_ADD(X, STREAM_VEC_ADD(X, X))
+
+// Vector version of STREAM_KERNEL_APPLY
+static inline stream_vec
+stream_simd_apply(long kernel, const long * a, const long * b)
+{
+    stream_vec va = STREAM_VEC_LOADU(a);
+    switch (kernel) {
+        case STREAM_COPY:  return va;
+        case STREAM_SCALE: return STREAM_VEC_TIMES3(va);
+        case STREAM_ADD:   return STREAM_VEC_ADD(va, STREAM_VEC_LOADU(b));
+        default:           return STREAM_VEC_ADD(va, STREAM_VEC_TIMES3(STREAM_VEC_LOADU(b)));
+    }
+}
+
+// Runs the kernel on elements [begin, end)
+static inline void
+stream_simd_kernel(long kernel, long * c, const long * a, const long * b, long begin, long end)
+{
+    long i = begin;
+    for (; i + STREAM_SIMD_WIDTH <= end; i += STREAM_SIMD_WIDTH) {
+        STREAM_VEC_STOREU(c + i, stream_simd_apply(kernel, a + i, b + i));
+    }
+    for (; i < end; ++i) {
+        STREAM_KERNEL_APPLY(kernel, c[i], a[i], b[i]);
+    }
+}
+
+// Same as stream_simd_kernel, but writes to c bypass the cache with non-temporal stores
+static inline void
+stream_simd_kernel_nt(long kernel, long * c, const long * a, const long * b, long begin, long end)
+{
+    const uintptr_t alignment = STREAM_SIMD_WIDTH * sizeof(long);
+    long i = begin;
+    // Streaming stores must be aligned, so do the first few elements one at a time
+    for (; i < end && ((uintptr_t)(c + i) & (alignment - 1)); ++i) {
+        STREAM_KERNEL_APPLY(kernel, c[i], a[i], b[i]);
+    }
+    for (; i + STREAM_SIMD_WIDTH <= end; i += STREAM_SIMD_WIDTH) {
+        STREAM_VEC_STREAM(c + i, stream_simd_apply(kernel, a + i, b + i));
+    }
+    for (; i < end; ++i) {
+        STREAM_KERNEL_APPLY(kernel, c[i], a[i], b[i]);
+    }
+    // Make the streaming stores visible before the thread finishes
+    _mm_sfence();
+}
+
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "common.h"
+
+/*
+ * List of thread counts to benchmark in a single run
+ *
+ * Accepted formats for the num_threads argument:
+ *     64              a single thread count
+ *     8,16,32         a comma-separated list
+ *     8:512:x2        a geometric range (begin:end:xFACTOR), inclusive
+ *     8:64:+8         an arithmetic range (begin:end:+STEP), inclusive
+ *     8:512           same as 8:512:x2
+ */
+#define THREAD_SWEEP_MAX 256
+
+typedef struct thread_sweep {
+    long values[THREAD_SWEEP_MAX];
+    long count;
+} thread_sweep;
+
+static inline void
+thread_sweep_append(thread_sweep * sweep, long num_threads)
+{
+    runtime_assert(num_threads > 0, "num_threads must be > 0");
+    runtime_assert(sweep->count < THREAD_SWEEP_MAX, "Too many thread counts in num_threads list");
+    sweep->values[sweep->count++] = num_threads;
+}
+
+static inline thread_sweep
+thread_sweep_parse(const char * arg)
+{
+    thread_sweep sweep;
+    sweep.count = 0;
+
+    if (strchr(arg, ':')) {
+        char * rest;
+        long begin = strtol(arg, &rest, 10);
+        runtime_assert(*rest == ':', "Invalid num_threads range");
+        long end = strtol(rest + 1, &rest, 10);
+        char op = 'x';
+        long step = 2;
+        if (*rest == ':') {
+            op = rest[1];
+            runtime_assert(op == 'x' || op == '+', "num_threads range step must start with 'x' or '+'");
+            step = strtol(rest + 2, &rest, 10);
+        }
+        runtime_assert(*rest == '\0', "Invalid num_threads range");
+        runtime_assert(begin > 0 && end >= begin, "Invalid num_threads range");
+        runtime_assert(op == 'x' ? step > 1 : step > 0, "num_threads range step must make progress");
+        for (long t = begin; t <= end; t = (op == 'x') ? t * step : t + step) {
+            thread_sweep_append(&sweep, t);
+        }
+    } else {
+        const char * p = arg;
+        for (;;) {
+            char * rest;
+            thread_sweep_append(&sweep, strtol(p, &rest, 10));
+            if (*rest == '\0') { break; }
+            runtime_assert(*rest == ',', "Invalid num_threads list");
+            p = rest + 1;
+        }
+    }
+    return sweep;
+}